@@ -78,8 +78,37 @@ tss_flush:
         ltr ax                  ; 5th selector (entries of 8 bytes). We set the bottom two bits
         ret                     ; for an RPL = 3
 
+[global switch_context]
+switch_context:
+        mov     eax, [esp + 4]  ; where to save the current esp
+        mov     edx, [esp + 8]  ; esp of the thread to resume
+        push    ebp             ; only the callee-saved registers need to be kept,
+        push    ebx             ; the caller already saved everything else
+        push    esi
+        push    edi
+        mov     [eax], esp      ; save the current stack pointer
+        mov     esp, edx        ; switch to the new stack
+        pop     edi
+        pop     esi
+        pop     ebx
+        pop     ebp
+        ret                     ; return into the new thread
+
 [global read_eip]
 read_eip:
         pop eax                 ; get the return address
         jmp eax                 ; return. can't use RET since we popped 
 
+
+[global call_on_stack]
+call_on_stack:
+        push    ebp
+        mov     ebp, esp
+        mov     eax, [ebp + 8]  ; function to call
+        mov     ecx, [ebp + 12] ; its argument
+        mov     esp, [ebp + 16] ; top of the stack to run it on
+        push    ecx
+        call    eax
+        mov     esp, ebp        ; back to the caller's stack
+        pop     ebp
+        ret
@@ -15,8 +15,9 @@ bootstrap               equ (_bootstrap - 0xc0000000)
 
 MBOOT_PAGE_ALIGN        equ 1 << 0      ; load kernel and modules on a page boundary
 MBOOT_MEM_INFO          equ 1 << 1      ; we want memory info
+MBOOT_VIDEO_MODE        equ 1 << 2      ; we want a linear framebuffer
 MBOOT_HEADER_MAGIC      equ 0x1badb002  ; multiboot magic value
-MBOOT_HEADER_FLAGS      equ MBOOT_PAGE_ALIGN | MBOOT_MEM_INFO
+MBOOT_HEADER_FLAGS      equ MBOOT_PAGE_ALIGN | MBOOT_MEM_INFO | MBOOT_VIDEO_MODE
 MBOOT_CHECKSUM          equ -(MBOOT_HEADER_MAGIC + MBOOT_HEADER_FLAGS)
 STACK_SIZE              equ 0x4000      ; 16k stack
 ATTR                    equ 3           ; present | writable | supervisor mode
@@ -31,6 +32,11 @@ multiboot_header:
         dd  MBOOT_HEADER_MAGIC      ; we are multiboot compatible
         dd  MBOOT_HEADER_FLAGS      ; how the bootloader will boot us
         dd  MBOOT_CHECKSUM          ; to ensure that the above values are correct
+        dd  0, 0, 0, 0, 0           ; load addresses, unused without bit 16
+        dd  0                       ; linear graphics mode
+        dd  1024                    ; width
+        dd  768                     ; height
+        dd  32                      ; bits per pixel
 
 _bootstrap:
         cli
@@ -0,0 +1,73 @@
+#include <system.h>
+#include <vsprintf.h>
+#include <cpufeature.h>
+
+#define CPUID_FPU       (1 << 0)
+#define CPUID_PSE       (1 << 3)
+#define CPUID_TSC       (1 << 4)
+#define CPUID_APIC      (1 << 9)
+#define CPUID_SEP       (1 << 11)
+#define CPUID_PGE       (1 << 13)
+#define CPUID_PAT       (1 << 16)
+#define CPUID_FXSR      (1 << 24)
+#define CPUID_SSE       (1 << 25)
+#define CPUID_SSE2      (1 << 26)
+#define CPUID7_ERMSB    (1 << 9)    /* in EBX of leaf 7 */
+
+uint32_t cpu_signature = 0;
+
+static const struct
+{
+    uint32_t   feature;
+    const char *name;
+} feature_names[] =
+{
+    { CPU_FPU, "fpu" }, { CPU_PSE, "pse" }, { CPU_TSC, "tsc" },
+    { CPU_APIC, "apic" }, { CPU_SEP, "sep" }, { CPU_PGE, "pge" },
+    { CPU_PAT, "pat" }, { CPU_FXSR, "fxsr" }, { CPU_SSE, "sse" },
+    { CPU_SSE2, "sse2" }, { CPU_ERMSB, "ermsb" }
+};
+
+/* cpuid() only gives EAX and EDX */
+static uint32_t cpuid_ebx(uint32_t code, uint32_t sub)
+{
+    uint32_t a, b, c, d;
+    asm volatile ("cpuid" : "=a"(a), "=b"(b), "=c"(c), "=d"(d) : "0"(code), "2"(sub));
+    return b;
+}
+
+void cpu_features_init(void)
+{
+    uint32_t max, a, d, i;
+    char names[96];
+    size_t len = 0;
+    static const uint32_t edx_bits[][2] =
+    {
+        { CPUID_FPU, CPU_FPU }, { CPUID_PSE, CPU_PSE }, { CPUID_TSC, CPU_TSC },
+        { CPUID_APIC, CPU_APIC }, { CPUID_SEP, CPU_SEP }, { CPUID_PGE, CPU_PGE },
+        { CPUID_PAT, CPU_PAT }, { CPUID_FXSR, CPU_FXSR }, { CPUID_SSE, CPU_SSE },
+        { CPUID_SSE2, CPU_SSE2 }
+    };
+
+    cpuid(0, &max, &d);
+    cpuid(1, &a, &d);
+    cpu_signature = a;
+
+    for (i = 0; i < sizeof(edx_bits) / sizeof(edx_bits[0]); ++i) {
+        if (d & edx_bits[i][0]) {
+            cpu_features |= edx_bits[i][1];
+        }
+    }
+    if (max >= 7 && (cpuid_ebx(7, 0) & CPUID7_ERMSB)) {
+        cpu_features |= CPU_ERMSB;
+    }
+
+    names[0] = '\0';
+    for (i = 0; i < sizeof(feature_names) / sizeof(feature_names[0]); ++i) {
+        if (cpu_has(feature_names[i].feature) && len < sizeof(names)) {
+            len += snprintf(names + len, sizeof(names) - len, " %s", feature_names[i].name);
+        }
+    }
+    kprintf(INFO, "[cpu] Family %u model %u stepping %u:%s\n",
+            (a >> 8) & 0xf, (a >> 4) & 0xf, a & 0xf, names);
+}
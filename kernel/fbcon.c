@@ -0,0 +1,441 @@
+#include <system.h>
+#include <multiboot.h>
+#include <paging.h>
+#include <kheap.h>
+#include <spinlock.h>
+#include <string.h>
+#include <fbcon.h>
+
+/* Text console on a linear framebuffer of 16, 24 or 32 bits per pixel,
+ * the palette is converted to its pixel format once. The text is kept as cells
+ * of a character and a VGA attribute, like the text mode, and a second
+ * grid holds what the screen shows. Writing only changes cells and grows
+ * a dirty rectangle, the flush at the end of a write draws the cells of
+ * the rectangle that differ from the screen. Scrolling moves the cells up
+ * with a single memmove, the lines which stay the same aren't redrawn.
+ *
+ * The framebuffer is the one the boot loader set up, otherwise the Bochs
+ * display adapter found in Bochs and QEMU (-vga std) is programmed. */
+
+#define FONT_FIRST      ' '
+#define FONT_LAST       '~'
+#define GLYPH_WIDTH     8
+#define GLYPH_HEIGHT    8
+#define CELL_HEIGHT     10      /* a blank line above and below the glyph */
+
+#define FB_WIDTH        1024
+#define FB_HEIGHT       768
+
+#define BGA_INDEX       0x1ce
+#define BGA_DATA        0x1cf
+#define BGA_ID          0
+#define BGA_XRES        1
+#define BGA_YRES        2
+#define BGA_BPP         3
+#define BGA_ENABLE      4
+#define BGA_ID_MIN      0xb0c0
+#define BGA_ID_MAX      0xb0c5
+#define BGA_ENABLED     0x01
+#define BGA_LFB         0x40
+#define BGA_LFB_DEFAULT 0xe0000000  /* where Bochs puts it */
+#define BGA_VENDOR      0x1234
+#define BGA_DEVICE      0x1111
+
+#define PCI_ADDRESS     0xcf8
+#define PCI_DATA        0xcfc
+
+/* 5x7 glyphs with a descender row, one column of margin on the left */
+static const uint8_t font[FONT_LAST - FONT_FIRST + 1][GLYPH_HEIGHT] =
+{
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, /* ' ' */
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x10, 0x00 }, /* '!' */
+    { 0x28, 0x28, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00 }, /* '"' */
+    { 0x28, 0x28, 0x7c, 0x28, 0x7c, 0x28, 0x28, 0x00 }, /* '#' */
+    { 0x10, 0x3c, 0x50, 0x38, 0x14, 0x78, 0x10, 0x00 }, /* '$' */
+    { 0x60, 0x64, 0x08, 0x10, 0x20, 0x4c, 0x0c, 0x00 }, /* '%' */
+    { 0x30, 0x48, 0x50, 0x20, 0x54, 0x48, 0x34, 0x00 }, /* '&' */
+    { 0x10, 0x10, 0x20, 0x00, 0x00, 0x00, 0x00, 0x00 }, /* '\'' */
+    { 0x08, 0x10, 0x20, 0x20, 0x20, 0x10, 0x08, 0x00 }, /* '(' */
+    { 0x20, 0x10, 0x08, 0x08, 0x08, 0x10, 0x20, 0x00 }, /* ')' */
+    { 0x00, 0x10, 0x54, 0x38, 0x54, 0x10, 0x00, 0x00 }, /* '*' */
+    { 0x00, 0x10, 0x10, 0x7c, 0x10, 0x10, 0x00, 0x00 }, /* '+' */
+    { 0x00, 0x00, 0x00, 0x00, 0x30, 0x10, 0x20, 0x00 }, /* ',' */
+    { 0x00, 0x00, 0x00, 0x7c, 0x00, 0x00, 0x00, 0x00 }, /* '-' */
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x30, 0x30, 0x00 }, /* '.' */
+    { 0x00, 0x04, 0x08, 0x10, 0x20, 0x40, 0x00, 0x00 }, /* '/' */
+    { 0x38, 0x44, 0x4c, 0x54, 0x64, 0x44, 0x38, 0x00 }, /* '0' */
+    { 0x10, 0x30, 0x10, 0x10, 0x10, 0x10, 0x38, 0x00 }, /* '1' */
+    { 0x38, 0x44, 0x04, 0x08, 0x10, 0x20, 0x7c, 0x00 }, /* '2' */
+    { 0x7c, 0x08, 0x10, 0x08, 0x04, 0x44, 0x38, 0x00 }, /* '3' */
+    { 0x08, 0x18, 0x28, 0x48, 0x7c, 0x08, 0x08, 0x00 }, /* '4' */
+    { 0x7c, 0x40, 0x78, 0x04, 0x04, 0x44, 0x38, 0x00 }, /* '5' */
+    { 0x18, 0x20, 0x40, 0x78, 0x44, 0x44, 0x38, 0x00 }, /* '6' */
+    { 0x7c, 0x04, 0x08, 0x10, 0x20, 0x20, 0x20, 0x00 }, /* '7' */
+    { 0x38, 0x44, 0x44, 0x38, 0x44, 0x44, 0x38, 0x00 }, /* '8' */
+    { 0x38, 0x44, 0x44, 0x3c, 0x04, 0x08, 0x30, 0x00 }, /* '9' */
+    { 0x00, 0x30, 0x30, 0x00, 0x30, 0x30, 0x00, 0x00 }, /* ':' */
+    { 0x00, 0x30, 0x30, 0x00, 0x30, 0x10, 0x20, 0x00 }, /* ';' */
+    { 0x08, 0x10, 0x20, 0x40, 0x20, 0x10, 0x08, 0x00 }, /* '<' */
+    { 0x00, 0x00, 0x7c, 0x00, 0x7c, 0x00, 0x00, 0x00 }, /* '=' */
+    { 0x20, 0x10, 0x08, 0x04, 0x08, 0x10, 0x20, 0x00 }, /* '>' */
+    { 0x38, 0x44, 0x04, 0x08, 0x10, 0x00, 0x10, 0x00 }, /* '?' */
+    { 0x38, 0x44, 0x04, 0x34, 0x54, 0x54, 0x38, 0x00 }, /* '@' */
+    { 0x38, 0x44, 0x44, 0x7c, 0x44, 0x44, 0x44, 0x00 }, /* 'A' */
+    { 0x78, 0x44, 0x44, 0x78, 0x44, 0x44, 0x78, 0x00 }, /* 'B' */
+    { 0x38, 0x44, 0x40, 0x40, 0x40, 0x44, 0x38, 0x00 }, /* 'C' */
+    { 0x70, 0x48, 0x44, 0x44, 0x44, 0x48, 0x70, 0x00 }, /* 'D' */
+    { 0x7c, 0x40, 0x40, 0x78, 0x40, 0x40, 0x7c, 0x00 }, /* 'E' */
+    { 0x7c, 0x40, 0x40, 0x78, 0x40, 0x40, 0x40, 0x00 }, /* 'F' */
+    { 0x38, 0x44, 0x40, 0x5c, 0x44, 0x44, 0x3c, 0x00 }, /* 'G' */
+    { 0x44, 0x44, 0x44, 0x7c, 0x44, 0x44, 0x44, 0x00 }, /* 'H' */
+    { 0x38, 0x10, 0x10, 0x10, 0x10, 0x10, 0x38, 0x00 }, /* 'I' */
+    { 0x1c, 0x08, 0x08, 0x08, 0x08, 0x48, 0x30, 0x00 }, /* 'J' */
+    { 0x44, 0x48, 0x50, 0x60, 0x50, 0x48, 0x44, 0x00 }, /* 'K' */
+    { 0x40, 0x40, 0x40, 0x40, 0x40, 0x40, 0x7c, 0x00 }, /* 'L' */
+    { 0x44, 0x6c, 0x54, 0x54, 0x44, 0x44, 0x44, 0x00 }, /* 'M' */
+    { 0x44, 0x44, 0x64, 0x54, 0x4c, 0x44, 0x44, 0x00 }, /* 'N' */
+    { 0x38, 0x44, 0x44, 0x44, 0x44, 0x44, 0x38, 0x00 }, /* 'O' */
+    { 0x78, 0x44, 0x44, 0x78, 0x40, 0x40, 0x40, 0x00 }, /* 'P' */
+    { 0x38, 0x44, 0x44, 0x44, 0x54, 0x48, 0x34, 0x00 }, /* 'Q' */
+    { 0x78, 0x44, 0x44, 0x78, 0x50, 0x48, 0x44, 0x00 }, /* 'R' */
+    { 0x3c, 0x40, 0x40, 0x38, 0x04, 0x04, 0x78, 0x00 }, /* 'S' */
+    { 0x7c, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00 }, /* 'T' */
+    { 0x44, 0x44, 0x44, 0x44, 0x44, 0x44, 0x38, 0x00 }, /* 'U' */
+    { 0x44, 0x44, 0x44, 0x44, 0x44, 0x28, 0x10, 0x00 }, /* 'V' */
+    { 0x44, 0x44, 0x44, 0x54, 0x54, 0x54, 0x28, 0x00 }, /* 'W' */
+    { 0x44, 0x44, 0x28, 0x10, 0x28, 0x44, 0x44, 0x00 }, /* 'X' */
+    { 0x44, 0x44, 0x44, 0x28, 0x10, 0x10, 0x10, 0x00 }, /* 'Y' */
+    { 0x7c, 0x04, 0x08, 0x10, 0x20, 0x40, 0x7c, 0x00 }, /* 'Z' */
+    { 0x38, 0x20, 0x20, 0x20, 0x20, 0x20, 0x38, 0x00 }, /* '[' */
+    { 0x00, 0x40, 0x20, 0x10, 0x08, 0x04, 0x00, 0x00 }, /* backslash */
+    { 0x38, 0x08, 0x08, 0x08, 0x08, 0x08, 0x38, 0x00 }, /* ']' */
+    { 0x10, 0x28, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00 }, /* '^' */
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7c, 0x00 }, /* '_' */
+    { 0x20, 0x10, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00 }, /* '`' */
+    { 0x00, 0x00, 0x38, 0x04, 0x3c, 0x44, 0x3c, 0x00 }, /* 'a' */
+    { 0x40, 0x40, 0x58, 0x64, 0x44, 0x44, 0x78, 0x00 }, /* 'b' */
+    { 0x00, 0x00, 0x38, 0x40, 0x40, 0x44, 0x38, 0x00 }, /* 'c' */
+    { 0x04, 0x04, 0x34, 0x4c, 0x44, 0x44, 0x3c, 0x00 }, /* 'd' */
+    { 0x00, 0x00, 0x38, 0x44, 0x7c, 0x40, 0x38, 0x00 }, /* 'e' */
+    { 0x18, 0x24, 0x20, 0x70, 0x20, 0x20, 0x20, 0x00 }, /* 'f' */
+    { 0x00, 0x00, 0x3c, 0x44, 0x44, 0x3c, 0x04, 0x38 }, /* 'g' */
+    { 0x40, 0x40, 0x58, 0x64, 0x44, 0x44, 0x44, 0x00 }, /* 'h' */
+    { 0x10, 0x00, 0x30, 0x10, 0x10, 0x10, 0x38, 0x00 }, /* 'i' */
+    { 0x08, 0x00, 0x18, 0x08, 0x08, 0x08, 0x48, 0x30 }, /* 'j' */
+    { 0x40, 0x40, 0x48, 0x50, 0x60, 0x50, 0x48, 0x00 }, /* 'k' */
+    { 0x30, 0x10, 0x10, 0x10, 0x10, 0x10, 0x38, 0x00 }, /* 'l' */
+    { 0x00, 0x00, 0x68, 0x54, 0x54, 0x44, 0x44, 0x00 }, /* 'm' */
+    { 0x00, 0x00, 0x58, 0x64, 0x44, 0x44, 0x44, 0x00 }, /* 'n' */
+    { 0x00, 0x00, 0x38, 0x44, 0x44, 0x44, 0x38, 0x00 }, /* 'o' */
+    { 0x00, 0x00, 0x78, 0x44, 0x44, 0x78, 0x40, 0x40 }, /* 'p' */
+    { 0x00, 0x00, 0x3c, 0x44, 0x44, 0x3c, 0x04, 0x04 }, /* 'q' */
+    { 0x00, 0x00, 0x58, 0x64, 0x40, 0x40, 0x40, 0x00 }, /* 'r' */
+    { 0x00, 0x00, 0x3c, 0x40, 0x38, 0x04, 0x78, 0x00 }, /* 's' */
+    { 0x20, 0x20, 0x70, 0x20, 0x20, 0x24, 0x18, 0x00 }, /* 't' */
+    { 0x00, 0x00, 0x44, 0x44, 0x44, 0x4c, 0x34, 0x00 }, /* 'u' */
+    { 0x00, 0x00, 0x44, 0x44, 0x44, 0x28, 0x10, 0x00 }, /* 'v' */
+    { 0x00, 0x00, 0x44, 0x44, 0x54, 0x54, 0x28, 0x00 }, /* 'w' */
+    { 0x00, 0x00, 0x44, 0x28, 0x10, 0x28, 0x44, 0x00 }, /* 'x' */
+    { 0x00, 0x00, 0x44, 0x44, 0x44, 0x3c, 0x04, 0x38 }, /* 'y' */
+    { 0x00, 0x00, 0x7c, 0x08, 0x10, 0x20, 0x7c, 0x00 }, /* 'z' */
+    { 0x08, 0x10, 0x10, 0x20, 0x10, 0x10, 0x08, 0x00 }, /* '{' */
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00 }, /* '|' */
+    { 0x20, 0x10, 0x10, 0x08, 0x10, 0x10, 0x20, 0x00 }, /* '}' */
+    { 0x00, 0x00, 0x20, 0x54, 0x08, 0x00, 0x00, 0x00 }, /* '~' */
+};
+
+static const uint32_t palette[16] =
+{
+    0x000000, 0x0000aa, 0x00aa00, 0x00aaaa, 0xaa0000, 0xaa00aa, 0xaa5500, 0xaaaaaa,
+    0x555555, 0x5555ff, 0x55ff55, 0x55ffff, 0xff5555, 0xff55ff, 0xffff55, 0xffffff
+};
+
+static volatile uint8_t *fb;
+static uint32_t pitch;              /* in bytes */
+static uint32_t bytes_pp;           /* bytes per pixel */
+static uint32_t colors[16];         /* the palette as pixels */
+static uint32_t cols, rows;
+static uint16_t *cells;             /* what was written */
+static uint16_t *shown;             /* what the screen has */
+static uint32_t xpos = 0, ypos = 0;
+static uint32_t cursor = 0;         /* cell drawn with the cursor */
+static uint16_t attribute = 0x0f00;
+static device_t fb_device;
+static spinlock_t fb_lock = SPINLOCK_INIT("fbcon");
+
+/* in cells, empty while top > bottom */
+static uint32_t dirty_top, dirty_bottom, dirty_left, dirty_right;
+
+static void mark(uint32_t x, uint32_t y)
+{
+    if (dirty_top > dirty_bottom) {
+        dirty_top = dirty_bottom = y;
+        dirty_left = dirty_right = x;
+        return;
+    }
+    if (y < dirty_top) {
+        dirty_top = y;
+    } else if (y > dirty_bottom) {
+        dirty_bottom = y;
+    }
+    if (x < dirty_left) {
+        dirty_left = x;
+    } else if (x > dirty_right) {
+        dirty_right = x;
+    }
+}
+
+static void mark_all(void)
+{
+    dirty_top = dirty_left = 0;
+    dirty_bottom = rows - 1;
+    dirty_right = cols - 1;
+}
+
+/* the component keeps its top bits, at its place in the pixel */
+static uint32_t pack(uint32_t rgb, uint8_t rpos, uint8_t rsize, uint8_t gpos,
+                     uint8_t gsize, uint8_t bpos, uint8_t bsize)
+{
+    return ((rgb >> 16 & 0xff) >> (8 - rsize)) << rpos |
+           ((rgb >> 8 & 0xff) >> (8 - gsize)) << gpos |
+           ((rgb & 0xff) >> (8 - bsize)) << bpos;
+}
+
+/* each pixel is picked between the background and the foreground
+ * without branching */
+static void draw_cell(uint32_t x, uint32_t y, uint16_t cell, int has_cursor)
+{
+    uint32_t fg = colors[(cell >> 8) & 0xf];
+    uint32_t bg = colors[(cell >> 12) & 0xf];
+    uint32_t diff = fg ^ bg;
+    uint8_t c = cell & 0xff;
+    const uint8_t *glyph = font[(c >= FONT_FIRST && c <= FONT_LAST ? c : '?') - FONT_FIRST];
+    volatile uint8_t *p = fb + y * CELL_HEIGHT * pitch + x * GLYPH_WIDTH * bytes_pp;
+    volatile uint8_t *q;
+    uint32_t row, bits, i, pixel;
+
+    for (row = 0; row < CELL_HEIGHT; ++row, p += pitch) {
+        bits = (row >= 1 && row <= GLYPH_HEIGHT) ? glyph[row - 1] : 0;
+        if (has_cursor && row == CELL_HEIGHT - 1) {
+            bits = 0xff;
+        }
+        for (i = 0; i < GLYPH_WIDTH; ++i) {
+            pixel = bg ^ (diff & -((bits >> (7 - i)) & 1));
+            if (bytes_pp == 4) {
+                ((volatile uint32_t *)p)[i] = pixel;
+            } else if (bytes_pp == 2) {
+                ((volatile uint16_t *)p)[i] = pixel;
+            } else {
+                q = p + i * 3;
+                q[0] = pixel;
+                q[1] = pixel >> 8;
+                q[2] = pixel >> 16;
+            }
+        }
+    }
+}
+
+/* draws the changed cells of the dirty rectangle, with the lock held */
+static void flush(void)
+{
+    uint32_t x, y, pos = ypos * cols + xpos;
+
+    /* the cells under the old and the new cursor are drawn again */
+    if (pos != cursor) {
+        shown[cursor] = 0;
+        shown[pos] = 0;
+        mark(cursor % cols, cursor / cols);
+        mark(xpos, ypos);
+        cursor = pos;
+    }
+
+    for (y = dirty_top; y <= dirty_bottom && dirty_top <= dirty_bottom; ++y) {
+        for (x = dirty_left; x <= dirty_right; ++x) {
+            pos = y * cols + x;
+            if (cells[pos] != shown[pos]) {
+                draw_cell(x, y, cells[pos], pos == cursor);
+                shown[pos] = cells[pos];
+            }
+        }
+    }
+    dirty_top = 1;
+    dirty_bottom = 0;
+}
+
+static void scroll(void)
+{
+    if (ypos < rows) {
+        return;
+    }
+    memmove(cells, cells + cols, (rows - 1) * cols * sizeof(*cells));
+    memsetw(cells + (rows - 1) * cols, (uint8_t)' ' | attribute, cols);
+    ypos = rows - 1;
+    mark_all();
+}
+
+static void put_char(char c)
+{
+    if (c == 0x08 && xpos) {
+        --xpos;
+    } else if (c == 0x09) {
+        xpos = (xpos + 8) & ~(8 - 1);
+    } else if (c == '\r') {
+        xpos = 0;
+    } else if (c == '\n') {
+        xpos = 0;
+        ++ypos;
+    } else if (c >= ' ') {
+        cells[ypos * cols + xpos] = (uint8_t)c | attribute;
+        mark(xpos, ypos);
+        ++xpos;
+    }
+
+    if (xpos >= cols) {
+        xpos = 0;
+        ++ypos;
+    }
+    scroll();
+}
+
+/* same escapes as the text console, \033 followed by the attribute */
+static size_t fbcon_write(uint8_t *data, size_t len)
+{
+    size_t i;
+    irq_state_t irq_state = spin_lock_irqsave(&fb_lock);
+
+    for (i = 0; *data && i < len; ++data, ++i) {
+        if (*data == '\033') {
+            ++data;
+            ++i;
+            attribute = *data << 8 | (attribute & 0xf000);
+        } else {
+            put_char((char)*data);
+        }
+    }
+    flush();
+
+    spin_unlock_irqrestore(&fb_lock, irq_state);
+    return i;
+}
+
+static uint32_t pci_read(uint32_t bus, uint32_t dev, uint32_t func, uint32_t reg)
+{
+    outl(PCI_ADDRESS, 0x80000000 | bus << 16 | dev << 11 | func << 8 | (reg & 0xfc));
+    return inl(PCI_DATA);
+}
+
+static uint16_t bga_read(uint16_t index)
+{
+    outw(BGA_INDEX, index);
+    return inw(BGA_DATA);
+}
+
+static void bga_write(uint16_t index, uint16_t value)
+{
+    outw(BGA_INDEX, index);
+    outw(BGA_DATA, value);
+}
+
+/* the framebuffer address is in the first BAR of the adapter */
+static uintptr_t bga_find(void)
+{
+    uint16_t id = bga_read(BGA_ID);
+    uint32_t dev;
+
+    if (id < BGA_ID_MIN || id > BGA_ID_MAX) {
+        return 0;
+    }
+    for (dev = 0; dev < 32; ++dev) {
+        if (pci_read(0, dev, 0, 0) == (BGA_DEVICE << 16 | BGA_VENDOR)) {
+            return pci_read(0, dev, 0, 0x10) & ~0xf;
+        }
+    }
+    return BGA_LFB_DEFAULT;
+}
+
+static void bga_set_mode(uint32_t width, uint32_t height)
+{
+    bga_write(BGA_ENABLE, 0);
+    bga_write(BGA_XRES, width);
+    bga_write(BGA_YRES, height);
+    bga_write(BGA_BPP, 32);
+    bga_write(BGA_ENABLE, BGA_ENABLED | BGA_LFB);
+}
+
+/* returns 0 if there is no framebuffer to use, the text mode stays */
+device_t *fbcon_init(struct multiboot_info *mbi)
+{
+    uintptr_t phys = 0;
+    uint32_t width = 0, height = 0, bpp = 0, n;
+
+    if ((mbi->flags & MULTIBOOT_FRAMEBUFFER) && mbi->framebuffer_type != MULTIBOOT_FB_TEXT) {
+        bpp = mbi->framebuffer_bpp;
+    }
+    if (bpp && mbi->framebuffer_type == MULTIBOOT_FB_RGB &&
+        (bpp == 15 || bpp == 16 || bpp == 24 || bpp == 32) &&
+        mbi->red_size <= 8 && mbi->green_size <= 8 && mbi->blue_size <= 8 &&
+        !(mbi->framebuffer_addr >> 32)) {
+        phys = (uintptr_t)mbi->framebuffer_addr;
+        width = mbi->framebuffer_width;
+        height = mbi->framebuffer_height;
+        pitch = mbi->framebuffer_pitch;
+        bytes_pp = (bpp + 7) / 8;
+        for (n = 0; n < 16; ++n) {
+            colors[n] = pack(palette[n], mbi->red_position, mbi->red_size,
+                             mbi->green_position, mbi->green_size,
+                             mbi->blue_position, mbi->blue_size);
+        }
+    } else if ((phys = bga_find()) != 0) {
+        width = FB_WIDTH;
+        height = FB_HEIGHT;
+        pitch = FB_WIDTH * 4;
+        bytes_pp = 4;
+        for (n = 0; n < 16; ++n) {
+            colors[n] = palette[n];
+        }
+        bga_set_mode(width, height);
+    }
+    if (!phys) {
+        if (bpp) {
+            kprintf(WARNING, "[fbcon] Can't draw on the %u bits framebuffer\n", bpp);
+        } else {
+            kprintf(INFO, "[fbcon] No framebuffer, staying in text mode\n");
+        }
+        return 0;
+    }
+
+    fb = (volatile uint8_t *)paging_map_fb(phys, pitch * height);
+    if (!fb) {
+        kprintf(WARNING, "[fbcon] The framebuffer at %x doesn't fit its window\n", phys);
+        return 0;
+    }
+
+    cols = width / GLYPH_WIDTH;
+    rows = height / CELL_HEIGHT;
+    n = cols * rows;
+    cells = (uint16_t *)kmalloc(n * sizeof(*cells));
+    shown = (uint16_t *)kmalloc(n * sizeof(*shown));
+    if (!cells || !shown) {
+        if (cells) {
+            kfree(cells);
+        }
+        if (shown) {
+            kfree(shown);
+        }
+        kprintf(WARNING, "[fbcon] Out of memory\n");
+        return 0;
+    }
+
+    spin_lock_register(&fb_lock);
+
+    /* nothing on the screen is known, everything is drawn once */
+    memsetw(cells, (uint8_t)' ' | attribute, n);
+    memset(shown, 0, n * sizeof(*shown));
+    mark_all();
+
+    fb_device.read = 0;
+    fb_device.write = fbcon_write;
+
+    kprintf(INFO, "[fbcon] %ux%ux%u at %x, %ux%u characters\n", width, height, bytes_pp * 8, phys, cols, rows);
+    return &fb_device;
+}
@@ -0,0 +1,9 @@
+#ifndef __KERNEL_FBCON_H__
+#define __KERNEL_FBCON_H__
+
+#include <driver.h>
+#include <multiboot.h>
+
+device_t *fbcon_init(struct multiboot_info *mbi);
+
+#endif
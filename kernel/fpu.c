@@ -0,0 +1,156 @@
+#include <system.h>
+#include <kheap.h>
+#include <thread.h>
+#include <fpu.h>
+#include <smp.h>
+#include <cpufeature.h>
+
+/* The x87/SSE registers are switched lazily. CR0.TS is set whenever we
+ * switch to a thread that doesn't own the FPU, its first FPU or SSE
+ * instruction then raises #NM (device not available) and only at that
+ * point the owner's registers are saved and the new thread's restored.
+ * Every CPU has its own registers and thus its own owner. */
+
+#define CR0_MP          (1 << 1)    /* monitor coprocessor */
+#define CR0_EM          (1 << 2)    /* emulation */
+#define CR0_TS          (1 << 3)    /* task switched */
+#define CR0_NE          (1 << 5)    /* native FPU exceptions */
+#define CR4_OSFXSR      (1 << 9)    /* FXSAVE/FXRSTOR and SSE enabled */
+#define CR4_OSXMMEXCPT  (1 << 10)   /* unmasked SSE exceptions */
+
+#define MXCSR_DEFAULT   0x1f80      /* all SSE exceptions masked */
+
+#define FPU_VECTOR      7
+
+static int has_fxsr = 0;
+static int has_sse = 0;
+
+inline static uint32_t read_cr0(void)
+{
+    uint32_t cr0;
+    asm volatile("mov %%cr0, %0" : "=r"(cr0));
+    return cr0;
+}
+
+inline static void write_cr0(uint32_t cr0)
+{
+    asm volatile("mov %0, %%cr0" : : "r"(cr0));
+}
+
+inline static void clts(void)
+{
+    asm volatile("clts");
+}
+
+inline static void stts(void)
+{
+    write_cr0(read_cr0() | CR0_TS);
+}
+
+static void fpu_save(void *state)
+{
+    if (has_fxsr) {
+        asm volatile("fxsave (%0)" : : "r"(state) : "memory");
+    } else {
+        asm volatile("fnsave (%0); fwait" : : "r"(state) : "memory");
+    }
+}
+
+static void fpu_restore(void *state)
+{
+    if (has_fxsr) {
+        asm volatile("fxrstor (%0)" : : "r"(state));
+    } else {
+        asm volatile("frstor (%0)" : : "r"(state));
+    }
+}
+
+static void fpu_reset(void)
+{
+    uint32_t mxcsr = MXCSR_DEFAULT;
+
+    asm volatile("fninit");
+    if (has_sse) {
+        asm volatile("ldmxcsr %0" : : "m"(mxcsr));
+    }
+}
+
+static void fpu_trap(registers_t *regs)
+{
+    (void)regs;
+    cpu_t *cpu = this_cpu();
+    thread_t *thread = cpu->rq.current;
+
+    clts();
+
+    /* FPU used before threads exist, it simply belongs to nobody */
+    if (!thread || cpu->fpu_owner == thread) {
+        return;
+    }
+
+    if (cpu->fpu_owner) {
+        fpu_save(cpu->fpu_owner->fpu_state);
+    }
+
+    if (!thread->fpu_state) {
+        /* first FPU instruction of this thread */
+        thread->fpu_state = kmalloc_align(FPU_STATE_SIZE, FPU_STATE_ALIGN);
+        assert(thread->fpu_state != 0);
+        fpu_reset();
+    } else {
+        fpu_restore(thread->fpu_state);
+    }
+
+    cpu->fpu_owner = thread;
+}
+
+void fpu_init(void)
+{
+    has_fxsr = cpu_has(CPU_FXSR);
+    has_sse = has_fxsr && cpu_has(CPU_SSE);
+
+    fpu_init_ap();
+
+    attach_interrupt_handler(FPU_VECTOR, fpu_trap);
+}
+
+/* control registers are per CPU, each of them goes through this */
+void fpu_init_ap(void)
+{
+    uint32_t cr0;
+
+    cr0 = read_cr0();
+    cr0 &= ~(CR0_EM | CR0_TS);
+    cr0 |= CR0_MP | CR0_NE;
+    write_cr0(cr0);
+
+    if (has_fxsr) {
+        uint32_t cr4;
+        asm volatile("mov %%cr4, %0" : "=r"(cr4));
+        cr4 |= CR4_OSFXSR | (has_sse ? CR4_OSXMMEXCPT : 0);
+        asm volatile("mov %0, %%cr4" : : "r"(cr4));
+    }
+
+    fpu_reset();
+}
+
+/* called by the scheduler with the thread about to run */
+void fpu_switch(thread_t *next)
+{
+    if (next == this_cpu()->fpu_owner) {
+        clts();
+    } else {
+        stts();
+    }
+}
+
+void fpu_release(thread_t *thread)
+{
+    if (thread->cpu && thread->cpu->fpu_owner == thread) {
+        thread->cpu->fpu_owner = 0;
+    }
+    if (thread->fpu_state) {
+        kfree(thread->fpu_state);
+        thread->fpu_state = 0;
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef __KERNEL_FPU_H__
+#define __KERNEL_FPU_H__
+
+#include <types.h>
+
+#define FPU_STATE_SIZE  512     /* FXSAVE area, FSAVE only uses 108 bytes of it */
+#define FPU_STATE_ALIGN 16
+
+struct thread;
+
+void fpu_init(void);
+void fpu_init_ap(void);
+void fpu_switch(struct thread *next);
+void fpu_release(struct thread *thread);
+
+#endif
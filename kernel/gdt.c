@@ -1,6 +1,7 @@
 #include <system.h>
 #include <string.h>
 #include <gdt.h>
+#include <smp.h>
 
 #define ACCESS_KCODE (GDT_ACCESS_PRESENT | GDT_ACCESS_RING0 | GDT_ACCESS_ALWAYS1 | GDT_ACCESS_RW | GDT_ACCESS_EXECUTE)
 #define ACCESS_UCODE (GDT_ACCESS_PRESENT | GDT_ACCESS_RING3 | GDT_ACCESS_ALWAYS1 | GDT_ACCESS_RW | GDT_ACCESS_EXECUTE)
@@ -8,11 +9,11 @@
 #define ACCESS_UDATA (GDT_ACCESS_PRESENT | GDT_ACCESS_RING3 | GDT_ACCESS_ALWAYS1 | GDT_ACCESS_RW)
 #define GDT_FLAGS    (GDT_FLAG_GRANULARITY | GDT_FLAG_32BIT)
 
-static gdt_entry_t gdt_entries[GDT_NUM_ENTRIES];
-static gdt_ptr_t   gdt_ptr;
-tss_entry_t tss_entry;
+/* every CPU has its own GDT, they only differ by their TSS and the
+ * per-CPU segment which covers their cpu_t, and the empty segment telling
+ * user space which CPU it runs on */
 
-static void gdt_set_gate(gdt_index_t index, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags)
+static void gdt_set_gate(gdt_entry_t *gdt_entries, gdt_index_t index, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags)
 {
     gdt_entries[index].base_low    = base & 0xffff;
     gdt_entries[index].base_middle = (base >> 16) & 0xff;
@@ -24,35 +25,49 @@ static void gdt_set_gate(gdt_index_t index, uint32_t base, uint32_t limit, uint8
     gdt_entries[index].access      = access;
 }
 
-static void write_tss(gdt_index_t index, uint16_t ss0, uint32_t esp0)
+static void write_tss(cpu_t *cpu, gdt_index_t index, uint16_t ss0, uint32_t esp0)
 {
-    uint32_t base = (uint32_t)&tss_entry;
+    tss_entry_t *tss = &cpu->tss;
+    uint32_t base = (uint32_t)tss;
     uint32_t limit = base + sizeof(tss_entry_t);
 
-    gdt_set_gate(index, base, limit, 0xe9, 0x00);
+    gdt_set_gate(cpu->gdt, index, base, limit, 0xe9, 0x00);
 
-    memset(&tss_entry, 0, sizeof(tss_entry_t));
+    memset(tss, 0, sizeof(tss_entry_t));
 
-    tss_entry.ss0 = ss0;
-    tss_entry.esp0 = esp0;
-    tss_entry.cs = 0x0b;
-    tss_entry.ss = tss_entry.ds = tss_entry.es = tss_entry.fs = tss_entry.gs = 0x13;
+    tss->ss0 = ss0;
+    tss->esp0 = esp0;
+    tss->cs = 0x0b;
+    tss->ss = tss->ds = tss->es = tss->fs = tss->gs = 0x13;
 }
 
-void gdt_init()
+void gdt_init_cpu(cpu_t *cpu)
 {
-    gdt_ptr.base = gdt_entries;
-    gdt_ptr.limit = sizeof(gdt_entry_t) * GDT_NUM_ENTRIES - 1;
-
-    gdt_set_gate(GDT_INDEX_NULL, 0, 0, 0, 0);
-    gdt_set_gate(GDT_INDEX_KCODE, 0x00000000, 0xffffffff, ACCESS_KCODE, GDT_FLAGS);
-    gdt_set_gate(GDT_INDEX_UCODE, 0x00000000, 0xffffffff, ACCESS_UCODE, GDT_FLAGS);
-    gdt_set_gate(GDT_INDEX_KDATA, 0x00000000, 0xffffffff, ACCESS_KDATA, GDT_FLAGS);
-    gdt_set_gate(GDT_INDEX_UDATA, 0x00000000, 0xffffffff, ACCESS_UDATA, GDT_FLAGS);
+    gdt_entry_t *gdt_entries = cpu->gdt;
+
+    cpu->gdt_ptr.base = gdt_entries;
+    cpu->gdt_ptr.limit = sizeof(gdt_entry_t) * GDT_NUM_ENTRIES - 1;
+
+    gdt_set_gate(gdt_entries, GDT_INDEX_NULL, 0, 0, 0, 0);
+    gdt_set_gate(gdt_entries, GDT_INDEX_KCODE, 0x00000000, 0xffffffff, ACCESS_KCODE, GDT_FLAGS);
+    gdt_set_gate(gdt_entries, GDT_INDEX_UCODE, 0x00000000, 0xffffffff, ACCESS_UCODE, GDT_FLAGS);
+    gdt_set_gate(gdt_entries, GDT_INDEX_KDATA, 0x00000000, 0xffffffff, ACCESS_KDATA, GDT_FLAGS);
+    gdt_set_gate(gdt_entries, GDT_INDEX_UDATA, 0x00000000, 0xffffffff, ACCESS_UDATA, GDT_FLAGS);
     
-    write_tss(GDT_INDEX_TSS, 0x10, 0x00);
+    write_tss(cpu, GDT_INDEX_TSS, 0x10, 0x00);
+
+    cpu->self = cpu;
+    gdt_set_gate(gdt_entries, GDT_INDEX_PERCPU, (uint32_t)cpu, sizeof(cpu_t) - 1,
+                 ACCESS_KDATA, GDT_FLAG_32BIT);
+    gdt_set_gate(gdt_entries, GDT_INDEX_CPUNR, 0, cpu->id, ACCESS_UDATA, GDT_FLAG_32BIT);
 
-    gdt_flush(&gdt_ptr);
+    gdt_flush(&cpu->gdt_ptr);
     tss_flush();
+    asm volatile ("mov %0, %%gs" :: "r"((uint16_t)PERCPU_SEL));
+}
+
+void gdt_init()
+{
+    gdt_init_cpu(&cpus[0]);
 }
 
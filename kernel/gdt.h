@@ -3,7 +3,9 @@
 
 #include <types.h>
 
-#define GDT_NUM_ENTRIES 6
+#define GDT_NUM_ENTRIES 8
+#define PERCPU_SEL      0x30    /* loaded in gs, based on this CPU's cpu_t */
+#define CPUNR_SEL       0x3b    /* its limit is the CPU number, read with lsl */
 
 /* Access byte flags */
 #define GDT_ACCESS_ACCESSED     (0x01 << 0) /* accessed bit (set to 0, the cpu sets this to 1 when the segment is accessed) */
@@ -28,7 +30,9 @@ typedef enum
     GDT_INDEX_KDATA = 0x02,
     GDT_INDEX_UCODE = 0x03,
     GDT_INDEX_UDATA = 0x04,
-    GDT_INDEX_TSS   = 0x05
+    GDT_INDEX_TSS   = 0x05,
+    GDT_INDEX_PERCPU = 0x06,
+    GDT_INDEX_CPUNR = 0x07
 } gdt_index_t;
 
 typedef struct
@@ -78,7 +82,10 @@ typedef struct
     gdt_entry_t *base; /* address of first GDT entry */
 }  __attribute__((packed)) gdt_ptr_t;
 
+struct cpu;
+
 //void gdt_set_gate(gdt_index_t index, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags);
 void gdt_init();
+void gdt_init_cpu(struct cpu *cpu);
 
 #endif
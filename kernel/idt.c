@@ -93,3 +93,9 @@ void idt_init()
 
     idt_flush(&idt_ptr);
 }
+
+/* the table is shared, application processors just load it */
+void idt_load()
+{
+    idt_flush(&idt_ptr);
+}
@@ -38,5 +38,6 @@ typedef struct
 
 void idt_set_gate(uint8_t index, void (*callback)(), uint16_t selector, uint8_t flags);
 void idt_init();
+void idt_load();
 
 #endif
@@ -33,6 +33,17 @@
         jmp     irq_common_stub
 %endmacro
 
+; This macro creates a stub for an interrupt raised by the local APIC,
+; its timer or an inter-processor interrupt.
+%macro APIC 1
+    [global apic%1]
+    apic%1:
+        cli
+        push    dword 0
+        push    dword %1
+        jmp     apic_common_stub
+%endmacro
+
 ; ISR 15 is unassigned, 20-31 are reserved
 ISR_NOERRCODE 0
 ISR_NOERRCODE 1
@@ -83,6 +94,14 @@ IRQ 12
 IRQ 13
 IRQ 14
 IRQ 15
+APIC 240    ; LAPIC_TIMER
+APIC 241    ; IPI_RESCHED
+APIC 242    ; IPI_TIMER
+
+; The local APIC doesn't expect an EOI for spurious interrupts
+[global lapic_spurious]
+lapic_spurious:
+    iretd
 
 ; This is our common interrupt stub. It saves the processor state, sets
 ; up for kernel mode segments, calls the C-level fault handler,
@@ -108,6 +127,7 @@ IRQ 15
     mov     ds, ax
     mov     es, ax
     mov     fs, ax
+    mov     ax, 0x30    ; PERCPU_SEL, gs addresses this CPU's data
     mov     gs, ax
 
     push    esp         ; esp is pointing below this push (4 bytes above top)
@@ -136,3 +156,61 @@ IRQ 15
 
 INT_HANDLER_STUB isr
 INT_HANDLER_STUB irq
+INT_HANDLER_STUB apic
+
+; Fast system call entry. SYSENTER loaded esp with the address of this
+; CPU's TSS esp0, the kernel stack of the running thread. The caller left
+; its return address, edx and ecx on its stack and ebp points there, ebp
+; is user controlled so sysenter_dispatch checks the frame before reading
+; it. Only gs needs a kernel value, the other data segments are flat.
+[extern sysenter_dispatch]
+[extern syscall_exit]
+[global sysenter_entry]
+sysenter_entry:
+    mov     esp, [esp]
+    push    gs
+    push    ebp
+    push    edi             ; arguments of sysenter_dispatch
+    push    esi
+    push    ebp             ; the caller's frame
+    push    ebx
+    push    eax             ; system call number
+    mov     ax, 0x30        ; PERCPU_SEL
+    mov     gs, ax
+    sti
+    call    sysenter_dispatch
+    cli
+    push    eax             ; the result
+    call    syscall_exit
+    pop     eax
+    add     esp, 20         ; ebx, esi and edi were preserved by the callee
+    pop     ebp
+    pop     gs
+    mov     edx, [ebp]      ; SYSEXIT returns to edx with ecx as esp
+    lea     ecx, [ebp + 4]
+    sti                     ; takes effect after sysexit
+    sysexit
+
+; New threads start here the first time switch_context returns into them.
+; Their stack holds an interrupt frame built by create_thread, so finish
+; the context switch and leave through the same path as the stubs above.
+
+[extern schedule_tail]
+[global thread_trampoline]
+thread_trampoline:
+    call    schedule_tail
+
+    pop     gs
+    pop     fs
+    pop     es
+    pop     ds
+    pop     ebp
+    pop     edi
+    pop     esi
+    pop     edx
+    pop     ecx
+    pop     ebx
+    pop     eax
+
+    add     esp, 8      ; cleans up the stack (error code and isr number)
+    iretd
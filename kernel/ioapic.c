@@ -0,0 +1,89 @@
+#include <system.h>
+#include <spinlock.h>
+#include <paging.h>
+#include <mp.h>
+#include <ioapic.h>
+
+#define IOREGSEL            0x00    /* register index */
+#define IOWIN               0x10    /* register data, 32 bits wide */
+
+#define IOAPIC_ID           0x00
+#define IOAPIC_VERSION      0x01
+#define IOAPIC_REDTBL(pin)  (0x10 + 2 * (pin))
+
+#define RED_ACTIVE_LOW      (1 << 13)
+#define RED_LEVEL           (1 << 15)
+#define RED_MASKED          (1 << 16)
+
+static volatile uint32_t *ioapic = 0;
+static uint32_t num_pins = 0;
+static uint8_t irq_pins[MP_ISA_IRQS];
+static spinlock_t ioapic_lock = SPINLOCK_INIT("ioapic");
+
+static uint32_t ioapic_read(uint8_t reg)
+{
+    ioapic[IOREGSEL / 4] = reg;
+    return ioapic[IOWIN / 4];
+}
+
+static void ioapic_write(uint8_t reg, uint32_t value)
+{
+    ioapic[IOREGSEL / 4] = reg;
+    ioapic[IOWIN / 4] = value;
+}
+
+void ioapic_init(uintptr_t base)
+{
+    uint32_t pin;
+
+    ioapic = (volatile uint32_t *)paging_map_mmio(base);
+    num_pins = ((ioapic_read(IOAPIC_VERSION) >> 16) & 0xff) + 1;
+
+    for (pin = 0; pin < num_pins; ++pin) {
+        ioapic_write(IOAPIC_REDTBL(pin), RED_MASKED);
+        ioapic_write(IOAPIC_REDTBL(pin) + 1, 0);
+    }
+
+    kprintf(INFO, "[ioapic] IO-APIC #%u at %#010x, %u pins\n",
+            (ioapic_read(IOAPIC_ID) >> 24) & 0xf, base, num_pins);
+}
+
+/* the IRQ stays masked until enabled */
+void ioapic_route_irq(uint8_t irq, uint8_t pin, uint8_t vector, uint8_t apic_id, uint8_t flags)
+{
+    if (pin >= num_pins || irq >= MP_ISA_IRQS) {
+        return;
+    }
+    irq_pins[irq] = pin;
+
+    uint32_t low = vector | RED_MASKED |
+                   (flags & MP_IRQ_ACTIVE_LOW ? RED_ACTIVE_LOW : 0) |
+                   (flags & MP_IRQ_LEVEL ? RED_LEVEL : 0);
+
+    ioapic_write(IOAPIC_REDTBL(pin) + 1, (uint32_t)apic_id << 24);
+    ioapic_write(IOAPIC_REDTBL(pin), low);
+}
+
+static void ioapic_set_mask(uint8_t irq, int masked)
+{
+    if (irq >= MP_ISA_IRQS) {
+        return;
+    }
+    irq_state_t irq_state = spin_lock_irqsave(&ioapic_lock);
+
+    uint8_t pin = irq_pins[irq];
+    uint32_t low = ioapic_read(IOAPIC_REDTBL(pin));
+    ioapic_write(IOAPIC_REDTBL(pin), masked ? low | RED_MASKED : low & ~RED_MASKED);
+
+    spin_unlock_irqrestore(&ioapic_lock, irq_state);
+}
+
+void ioapic_enable_irq(uint8_t irq)
+{
+    ioapic_set_mask(irq, 0);
+}
+
+void ioapic_disable_irq(uint8_t irq)
+{
+    ioapic_set_mask(irq, 1);
+}
@@ -0,0 +1,11 @@
+#ifndef __KERNEL_IOAPIC_H__
+#define __KERNEL_IOAPIC_H__
+
+#include <types.h>
+
+void ioapic_init(uintptr_t base);
+void ioapic_route_irq(uint8_t irq, uint8_t pin, uint8_t vector, uint8_t apic_id, uint8_t flags);
+void ioapic_enable_irq(uint8_t irq);
+void ioapic_disable_irq(uint8_t irq);
+
+#endif
@@ -3,6 +3,10 @@
 #include <pic.h>
 #include <vga.h>
 #include <logging.h>
+#include <softirq.h>
+#include <workqueue.h>
+#include <spinlock.h>
+#include <scheduler.h>
 
 #define IRQ_KBD     1
 #define KBD_DATA    0x60
@@ -10,15 +14,41 @@
 
 #define LSHIFT      0x2a
 #define RSHIFT      0x36
-#define CAPSLOCK    0x1d
+#define CTRL        0x1d
+#define ALT         0x38
+#define CAPSLOCK    0x3a
+#define EXTENDED    0xe0    /* the next scancode is from the extended set */
+#define RELEASED    0x80
+
+/* The interrupt only grabs the scancode, the bottom half decodes it into
+ * an event with the modifiers held at the time and queues it. Readers
+ * sleep on the wait queue until an event comes, the oldest ones are
+ * dropped when nobody reads them. */
 
 static uint8_t last_char = 0;
-static uint32_t shift_pressed = 0;
+static uint16_t modifiers = 0;
+static uint8_t extended = 0;
 
 #define KBD_BUF_SIZE    32
-static uint8_t kbd_buffer[KBD_BUF_SIZE];
-static uint8_t read_idx = 0;
-static volatile uint8_t write_idx = 0;
+#define KBD_EVENTS      64
+static kbd_event_t events[KBD_EVENTS];
+static uint32_t event_head = 0;
+static uint32_t event_tail = 0;
+static spinlock_t event_lock = SPINLOCK_INIT("kbd");
+static wait_queue_t event_wait = WAIT_QUEUE_INIT("kbd wait");
+static device_t kbd_device;
+
+/* scancodes waiting for the bottom half, the indexes are only written by
+ * one side each */
+static uint8_t scan_buffer[KBD_BUF_SIZE];
+static volatile uint8_t scan_read_idx = 0;
+static volatile uint8_t scan_write_idx = 0;
+
+/* characters waiting to be echoed by the worker */
+static uint8_t echo_buffer[KBD_BUF_SIZE];
+static volatile uint8_t echo_read_idx = 0;
+static volatile uint8_t echo_write_idx = 0;
+static work_t echo_work;
 
 const uint8_t keymap_us[2][128] =
 {
@@ -92,45 +122,174 @@ static void keyboard_handler(registers_t *r)
 {
     (void)r;
     uint8_t scancode = inb(KBD_DATA);
-        
-    /* if the top bit of the byte is set, a key has just been released */
-    if (scancode & 0x80)
+
+    if (((scan_write_idx + 1) % KBD_BUF_SIZE) != scan_read_idx)
     {
-        scancode &= 0x7f;
-        if (scancode == LSHIFT || scancode == RSHIFT)
-        {
-            shift_pressed = 0;
-        }
+        scan_buffer[scan_write_idx] = scancode;
+        /* the scancode is there before the bottom half sees the index */
+        asm volatile ("" ::: "memory");
+        scan_write_idx = (scan_write_idx + 1) % KBD_BUF_SIZE;
+    }
+    softirq_raise(SOFTIRQ_KBD);
+}
+
+static void keyboard_echo(void *data)
+{
+    (void)data;
+    while (echo_read_idx != echo_write_idx)
+    {
+        vga_print_char(echo_buffer[echo_read_idx]);
+        echo_read_idx = (echo_read_idx + 1) % KBD_BUF_SIZE;
     }
-    else /* a key has just been pressed */
+}
+
+static uint16_t modifier(uint8_t code)
+{
+    switch (code)
     {
-        if (scancode == LSHIFT || scancode == RSHIFT)
+        case LSHIFT:
+        case RSHIFT:
+            return KBD_MOD_SHIFT;
+        case CTRL:
+            return KBD_MOD_CTRL;
+        case ALT:
+            return KBD_MOD_ALT;
+        default:
+            return 0;
+    }
+}
+
+static uint8_t translate(uint8_t code)
+{
+    int shift = (modifiers & KBD_MOD_SHIFT) != 0;
+    uint8_t c = keymap_us[0][code];
+
+    /* caps lock only applies to letters */
+    if (c >= 'a' && c <= 'z' && (modifiers & KBD_MOD_CAPSLOCK))
+    {
+        shift = !shift;
+    }
+    return keymap_us[shift][code];
+}
+
+static void queue_event(kbd_event_t *event)
+{
+    spin_lock(&event_lock);
+    if (event_head - event_tail == KBD_EVENTS)
+    {
+        ++event_tail;
+    }
+    events[event_head++ % KBD_EVENTS] = *event;
+    spin_unlock(&event_lock);
+}
+
+static void keyboard_bottom_half(void)
+{
+    uint8_t scancode, code;
+    kbd_event_t event;
+    int queued = 0;
+
+    while (scan_read_idx != scan_write_idx)
+    {
+        scancode = scan_buffer[scan_read_idx];
+        asm volatile ("" ::: "memory");
+        scan_read_idx = (scan_read_idx + 1) % KBD_BUF_SIZE;
+
+        if (scancode == EXTENDED)
+        {
+            extended = 1;
+            continue;
+        }
+        code = scancode & ~RELEASED;
+
+        /* if the top bit of the byte is set, a key has just been released */
+        if (scancode & RELEASED)
         {
-            shift_pressed = 1;
+            modifiers &= ~modifier(code);
         }
         else
         {
-            vga_print_char(keymap_us[shift_pressed][scancode]);
+            modifiers |= modifier(code);
+            if (code == CAPSLOCK)
+            {
+                modifiers ^= KBD_MOD_CAPSLOCK;
+            }
+        }
 
-            last_char = keymap_us[shift_pressed][scancode];
-            if (((write_idx + 1) % KBD_BUF_SIZE) != read_idx)
+        event.scancode = code;
+        event.flags = modifiers;
+        event.flags |= (scancode & RELEASED) ? KBD_RELEASE : 0;
+        event.flags |= extended ? KBD_EXTENDED : 0;
+        event.ascii = (extended || code >= 128) ? 0 : translate(code);
+        extended = 0;
+        queue_event(&event);
+        queued = 1;
+
+        if (!(event.flags & KBD_RELEASE) && event.ascii)
+        {
+            last_char = event.ascii;
+            if (((echo_write_idx + 1) % KBD_BUF_SIZE) != echo_read_idx)
+            {
+                echo_buffer[echo_write_idx] = last_char;
+                echo_write_idx = (echo_write_idx + 1) % KBD_BUF_SIZE;
+            }
+        }
+    }
+    if (queued)
+    {
+        wake_up_all(&event_wait);
+    }
+    if (echo_read_idx != echo_write_idx)
+    {
+        schedule_work(&echo_work);
+    }
+}
+
+/* returns 0 if there is no event and it shouldn't wait, may only wait in
+ * a thread */
+int keyboard_read_event(kbd_event_t *event, int wait)
+{
+    for (;;)
+    {
+        irq_state_t irq_state = spin_lock_irqsave(&event_lock);
+        if (event_tail != event_head)
+        {
+            *event = events[event_tail++ % KBD_EVENTS];
+            spin_unlock_irqrestore(&event_lock, irq_state);
+            /* we may have got on the wait queue below */
+            if (wait)
             {
-                kbd_buffer[write_idx] = last_char;
-                write_idx = (write_idx + 1) % KBD_BUF_SIZE;
+                wait_queue_remove(&event_wait);
             }
+            return 1;
         }
+        spin_unlock_irqrestore(&event_lock, irq_state);
+
+        if (!wait)
+        {
+            return 0;
+        }
+        wait_queue_add(&event_wait);
+        /* an event queued before we got on the wait queue */
+        if (event_tail != event_head)
+        {
+            continue;
+        }
+        block_thread();
     }
 }
 
+/* waits for a key giving a character */
 uint8_t keyboard_getchar()
 {
-    uint8_t c;
+    kbd_event_t event;
 
-    while (read_idx == write_idx) ;
+    do
+    {
+        keyboard_read_event(&event, 1);
+    } while ((event.flags & KBD_RELEASE) || !event.ascii);
 
-    c = kbd_buffer[read_idx];
-    read_idx = (read_idx + 1) % KBD_BUF_SIZE;
-    return c;
+    return event.ascii;
 }
 
 uint8_t keyboard_lastchar()
@@ -140,9 +299,34 @@ uint8_t keyboard_lastchar()
     return tmp;
 }
 
-void keyboard_init()
+/* waits for one character at least, then takes what is there */
+static size_t keyboard_read(uint8_t *data, size_t len)
 {
+    kbd_event_t event;
+    size_t n = 0;
+
+    while (n < len && keyboard_read_event(&event, n == 0))
+    {
+        if (!(event.flags & KBD_RELEASE) && event.ascii)
+        {
+            data[n++] = event.ascii;
+        }
+    }
+    return n;
+}
+
+device_t *keyboard_init()
+{
+    spin_lock_register(&event_lock);
+    spin_lock_register(&event_wait.lock);
+    work_init(&echo_work, keyboard_echo, 0);
+    softirq_register(SOFTIRQ_KBD, keyboard_bottom_half);
     attach_interrupt_handler(IRQ(IRQ_KBD), keyboard_handler);
-    pic_enable_irq(IRQ_KBD);
+    enable_irq(IRQ_KBD);
+
+    kbd_device.read = keyboard_read;
+    kbd_device.write = 0;
+
     kprintf(INFO, "[kbd] Keyboard initialized\n");
+    return &kbd_device;
 }
@@ -1,7 +1,25 @@
 #ifndef __KERNEL_KEYBOARD_H__
 #define __KERNEL_KEYBOARD_H__
 
-void keyboard_init();
+#include <types.h>
+#include <driver.h>
+
+#define KBD_MOD_SHIFT       (1 << 0)
+#define KBD_MOD_CTRL        (1 << 1)
+#define KBD_MOD_ALT         (1 << 2)
+#define KBD_MOD_CAPSLOCK    (1 << 3)
+#define KBD_RELEASE         (1 << 8)    /* the key went up */
+#define KBD_EXTENDED        (1 << 9)    /* prefixed by 0xe0 */
+
+typedef struct
+{
+    uint8_t  scancode;  /* without the release bit */
+    uint8_t  ascii;     /* 0 if the key gives no character */
+    uint16_t flags;     /* modifiers held, release and extended */
+} kbd_event_t;
+
+device_t *keyboard_init();
+int keyboard_read_event(kbd_event_t *event, int wait);
 uint8_t keyboard_getchar();
 uint8_t keyboard_lastchar();
 
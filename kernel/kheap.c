@@ -1,8 +1,11 @@
 #include <system.h>
+#include <spinlock.h>
 #include <paging.h>
 #include <logging.h>
 #include <kheap.h>
 #include <mem_alloc.h>
+#include <smp.h>
+#include <trace.h>
 
 extern uint32_t kernel_end;
 extern uint32_t kernel_voffset;
@@ -11,12 +14,20 @@ extern page_dir_t *kernel_directory;
 uintptr_t placement_address = (uintptr_t)&kernel_end;
 allocator_t *kheap = 0;
 
-static uint8_t volatile mem_lock = 0;
+/* every CPU allocates, waiters queue up instead of hammering the lock */
+static mcs_lock_t heap_lock = MCS_LOCK_INIT("kheap");
+
+void kheap_init()
+{
+    kheap = create_mem_allocator(KHEAP_START, KHEAP_START + KHEAP_INITIAL_SIZE,
+            HEAP_MIN_SIZE, HEAP_MAX_SIZE, 0, 0, this_cpu()->page_dir);
+    mcs_lock_register(&heap_lock);
+}
 
 static uintptr_t kmalloc_int(uint32_t size, uint32_t alignment, uintptr_t *phys)
 {
-    //spin_lock(&mem_lock);
-    irq_state_t irq_state = irq_save();
+    mcs_node_t node;
+    irq_state_t irq_state = mcs_lock_irqsave(&heap_lock, &node);
 
     uintptr_t addr;
     if (kheap != 0) {
@@ -39,8 +50,10 @@ static uintptr_t kmalloc_int(uint32_t size, uint32_t alignment, uintptr_t *phys)
         placement_address += size;
     }
 
-    irq_restore(irq_state);
-    //spin_unlock(&mem_lock);
+    mcs_unlock_irqrestore(&heap_lock, &node, irq_state);
+    if (kheap != 0) {
+        trace("kmalloc %u align %x = %x", size, alignment, addr);
+    }
     return addr;
 }
 
@@ -64,14 +77,19 @@ inline void *kmalloc_ap(uint32_t size, uintptr_t *phys)
     return (void *)kmalloc_int(size, FRAME_SIZE, phys);
 }
 
+inline void *kmalloc_align(uint32_t size, uint32_t alignment)
+{
+    return (void *)kmalloc_int(size, alignment, 0);
+}
+
 inline void kfree(void *p)
 {
-    //spin_lock(&mem_lock);
-    irq_state_t irq_state = irq_save();
+    mcs_node_t node;
+    irq_state_t irq_state = mcs_lock_irqsave(&heap_lock, &node);
 
     //kprintf(INFO, "\n--------------- free(%x) ---------------\n", p);
     free(p, kheap);
 
-    irq_restore(irq_state);
-    //spin_unlock(&mem_lock);
+    mcs_unlock_irqrestore(&heap_lock, &node, irq_state);
+    trace("kfree %x", p);
 }
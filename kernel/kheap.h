@@ -9,11 +9,12 @@
 #define HEAP_MIN_SIZE       0x00070000
 #define HEAP_MAX_SIZE       0x00f00000
 
-void kheap_init(); // XXX: this should be called instead of create_mem_allocator
+void kheap_init();
 void *kmalloc(uint32_t size);
 void *kmalloc_a(uint32_t size);
 void *kmalloc_p(uint32_t size, uintptr_t *phys);
 void *kmalloc_ap(uint32_t size, uintptr_t *phys);
+void *kmalloc_align(uint32_t size, uint32_t alignment);
 void kfree(void *p);
 
 #endif
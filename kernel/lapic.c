@@ -0,0 +1,291 @@
+#include <system.h>
+#include <spinlock.h>
+#include <paging.h>
+#include <idt.h>
+#include <pit.h>
+#include <smp.h>
+#include <lapic.h>
+#include <cpufeature.h>
+
+#define LAPIC_ID            0x020
+#define LAPIC_VERSION       0x030
+#define LAPIC_TPR           0x080   /* task priority */
+#define LAPIC_EOI           0x0b0
+#define LAPIC_SVR           0x0f0   /* spurious interrupt vector */
+#define LAPIC_ESR           0x280   /* error status */
+#define LAPIC_ICR_LOW       0x300   /* interrupt command */
+#define LAPIC_ICR_HIGH      0x310
+#define LAPIC_LVT_TIMER     0x320
+#define LAPIC_TIMER_INIT    0x380   /* initial count */
+#define LAPIC_TIMER_COUNT   0x390   /* current count */
+#define LAPIC_TIMER_DIVIDE  0x3e0
+
+#define SVR_ENABLE          (1 << 8)
+
+#define ICR_FIXED           (0x0 << 8)
+#define ICR_INIT            (0x5 << 8)
+#define ICR_STARTUP         (0x6 << 8)
+#define ICR_PENDING         (1 << 12)  /* delivery status */
+#define ICR_ASSERT          (1 << 14)
+#define ICR_LEVEL           (1 << 15)
+#define ICR_ALL_BUT_SELF    (0x3 << 18)
+
+#define LVT_MASKED          (1 << 16)
+#define LVT_PERIODIC        (1 << 17)
+#define TIMER_DIVIDE_16     0x3
+
+
+#define CALIBRATE_TICKS     10      /* PIT ticks the timer is measured over */
+
+extern void lapic_spurious();
+extern void apic240();
+
+static volatile uint32_t *lapic = 0;
+
+/* The timer counts down at the bus frequency, every CPU has its own but
+ * only the boot CPU's one keeps the time. In one-shot mode the ticks
+ * elapsed are measured with the TSC, which unlike the timer registers
+ * can be read from any CPU. */
+static uint32_t timer_count = 0;    /* timer counts per tick */
+static uint32_t tsc_per_tick = 0;
+static uint32_t max_oneshot = 0;    /* longest one-shot in ticks */
+static volatile uint32_t ticks = 0;
+static uint64_t tick_stamp = 0;     /* TSC at the last whole tick */
+static uint32_t oneshot_end = 0;    /* tick the one-shot expires at, 0 if periodic */
+static int oneshot = 0;
+static spinlock_t clock_lock = SPINLOCK_INIT("lapic clock");
+
+inline static uint32_t lapic_read(uint32_t reg)
+{
+    return lapic[reg / 4];
+}
+
+inline static void lapic_write(uint32_t reg, uint32_t value)
+{
+    lapic[reg / 4] = value;
+    (void)lapic[LAPIC_ID / 4]; /* wait for the write to finish */
+}
+
+int lapic_enabled(void)
+{
+    return lapic != 0;
+}
+
+int lapic_present(void)
+{
+    return cpu_has(CPU_APIC);
+}
+
+void lapic_init(uintptr_t base)
+{
+    lapic = (volatile uint32_t *)paging_map_mmio(base);
+
+    idt_set_gate(LAPIC_SPURIOUS, lapic_spurious, KCODE_SEL, IDT_FLAGS_RING0);
+    idt_set_gate(LAPIC_TIMER, apic240, KCODE_SEL, IDT_FLAGS_RING0);
+
+    lapic_init_ap();
+
+    kprintf(INFO, "[lapic] Local APIC #%u at %#010x (version %#x)\n",
+            lapic_id(), base, lapic_read(LAPIC_VERSION) & 0xff);
+}
+
+/* enable the local APIC of the calling CPU, the registers are at the
+ * same address for every CPU */
+void lapic_init_ap(void)
+{
+    lapic_write(LAPIC_TPR, 0);  /* accept every interrupt */
+    lapic_write(LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS);
+    lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_16);
+    lapic_timer_stop();
+    lapic_write(LAPIC_ESR, 0);
+    lapic_write(LAPIC_ESR, 0);
+    lapic_eoi();
+}
+
+uint32_t lapic_id(void)
+{
+    return lapic_read(LAPIC_ID) >> 24;
+}
+
+void lapic_eoi(void)
+{
+    lapic[LAPIC_EOI / 4] = 0;
+}
+
+static void lapic_send(uint32_t apic_id, uint32_t command)
+{
+    irq_state_t irq_state = irq_save();
+
+    lapic_write(LAPIC_ICR_HIGH, apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_PENDING) ;
+
+    irq_restore(irq_state);
+}
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector)
+{
+    lapic_send(apic_id, ICR_FIXED | ICR_ASSERT | vector);
+}
+
+void lapic_broadcast_ipi(uint8_t vector)
+{
+    lapic_send(0, ICR_ALL_BUT_SELF | ICR_FIXED | ICR_ASSERT | vector);
+}
+
+void lapic_send_init(uint32_t apic_id)
+{
+    lapic_send(apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+    lapic_send(apic_id, ICR_INIT | ICR_LEVEL);  /* de-assert */
+}
+
+void lapic_send_startup(uint32_t apic_id, uint8_t page)
+{
+    lapic_send(apic_id, ICR_STARTUP | page);
+}
+
+/* fold the time spent in one-shot mode into the tick count */
+static void lapic_catch_up(void)
+{
+    uint64_t delta = get_cycles_count() - tick_stamp;
+    uint32_t elapsed = delta > 0xffffffff ? 0xffffffff : (uint32_t)delta;
+    uint32_t n = elapsed / tsc_per_tick;
+
+    ticks += n;
+    tick_stamp += (uint64_t)n * tsc_per_tick;
+}
+
+static void lapic_timer_handler(registers_t *regs)
+{
+    (void)regs;
+    if (this_cpu() != &cpus[0]) {
+        return;
+    }
+
+    spin_lock(&clock_lock);
+    if (oneshot) {
+        /* the countdown expired and the timer stays silent until it is
+         * programmed again, the TSC may lag a little behind it */
+        lapic_catch_up();
+        if ((int32_t)(oneshot_end - ticks) > 0) {
+            ticks = oneshot_end;
+            tick_stamp = get_cycles_count();
+        }
+        oneshot = 0;
+    } else {
+        ++ticks;
+        tick_stamp = get_cycles_count();
+    }
+    spin_unlock(&clock_lock);
+}
+
+/* measure the timer and the TSC against the PIT, which is still ticking */
+void lapic_timer_init(void)
+{
+    uint32_t start, count;
+    uint64_t tsc;
+
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_TIMER);
+
+    start = pit_get_ticks();
+    while (pit_get_ticks() == start) {
+        halt();
+    }
+    start = pit_get_ticks();
+    lapic_write(LAPIC_TIMER_INIT, 0xffffffff);
+    tsc = get_cycles_count();
+
+    while (pit_get_ticks() - start < CALIBRATE_TICKS) {
+        halt();
+    }
+    count = 0xffffffff - lapic_read(LAPIC_TIMER_COUNT);
+    tsc = get_cycles_count() - tsc;
+    lapic_write(LAPIC_TIMER_INIT, 0);
+
+    timer_count = count / CALIBRATE_TICKS;
+    tsc_per_tick = (uint32_t)tsc / CALIBRATE_TICKS;
+    lapic_clock.cycles_per_tick = tsc_per_tick;
+    max_oneshot = min(0xffffffff / timer_count, 0x7fffffff / tsc_per_tick);
+    ticks = pit_get_ticks();
+    tick_stamp = get_cycles_count();
+
+    attach_interrupt_handler(LAPIC_TIMER, lapic_timer_handler);
+
+    kprintf(INFO, "[lapic] Timer: %u counts and %u cycles per tick\n",
+            timer_count, tsc_per_tick);
+}
+
+/* the local timers of the other CPUs only tick to preempt */
+void lapic_timer_periodic(void)
+{
+    lapic_write(LAPIC_LVT_TIMER, LVT_PERIODIC | LAPIC_TIMER);
+    lapic_write(LAPIC_TIMER_INIT, timer_count);
+}
+
+void lapic_timer_stop(void)
+{
+    lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LAPIC_TIMER);
+    lapic_write(LAPIC_TIMER_INIT, 0);
+}
+
+static uint32_t lapic_clock_ticks(void)
+{
+    uint32_t now;
+
+    if (!oneshot) {
+        return ticks;
+    }
+
+    irq_state_t irq_state = spin_lock_irqsave(&clock_lock);
+    if (oneshot) {
+        lapic_catch_up();
+    }
+    now = ticks;
+    spin_unlock_irqrestore(&clock_lock, irq_state);
+
+    return now;
+}
+
+static uint32_t lapic_clock_oneshot(uint32_t nticks)
+{
+    irq_state_t irq_state = spin_lock_irqsave(&clock_lock);
+
+    if (oneshot) {
+        lapic_catch_up();
+    }
+    if (nticks == 0) {
+        nticks = 1;
+    }
+    if (nticks > max_oneshot) {
+        nticks = max_oneshot;
+    }
+    oneshot = 1;
+    oneshot_end = ticks + nticks;
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER);
+    lapic_write(LAPIC_TIMER_INIT, nticks * timer_count);
+
+    spin_unlock_irqrestore(&clock_lock, irq_state);
+    return nticks;
+}
+
+static void lapic_clock_periodic(void)
+{
+    irq_state_t irq_state = spin_lock_irqsave(&clock_lock);
+
+    if (oneshot) {
+        lapic_catch_up();
+        oneshot = 0;
+    }
+    lapic_timer_periodic();
+
+    spin_unlock_irqrestore(&clock_lock, irq_state);
+}
+
+clock_event_t lapic_clock =
+{
+    .name      = "local APIC timer",
+    .vector    = LAPIC_TIMER,
+    .get_ticks = lapic_clock_ticks,
+    .oneshot   = lapic_clock_oneshot,
+    .periodic  = lapic_clock_periodic
+};
@@ -0,0 +1,29 @@
+#ifndef __KERNEL_LAPIC_H__
+#define __KERNEL_LAPIC_H__
+
+#include <types.h>
+#include <timer.h>
+
+#define LAPIC_DEFAULT_BASE  0xfee00000
+#define LAPIC_TIMER         0xf0    /* local timer vector */
+#define LAPIC_SPURIOUS      0xff    /* spurious interrupt vector */
+
+extern clock_event_t lapic_clock;
+
+int lapic_present(void);
+int lapic_enabled(void);
+void lapic_init(uintptr_t base);
+void lapic_init_ap(void);
+uint32_t lapic_id(void);
+void lapic_eoi(void);
+
+void lapic_send_ipi(uint32_t apic_id, uint8_t vector);
+void lapic_broadcast_ipi(uint8_t vector);
+void lapic_send_init(uint32_t apic_id);
+void lapic_send_startup(uint32_t apic_id, uint8_t page);
+
+void lapic_timer_init(void);
+void lapic_timer_periodic(void);
+void lapic_timer_stop(void);
+
+#endif
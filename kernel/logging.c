@@ -1,40 +1,293 @@
 #include <system.h>
+#include <spinlock.h>
 #include <logging.h>
 #include <driver.h>
+#include <serial.h>
 #include <stdarg.h>
 #include <vsprintf.h>
 #include <string.h>
+#include <workqueue.h>
+#include <smp.h>
+
+/* Messages are appended to a ring without taking a lock: a writer
+ * reserves its record by moving the head forward with a compare and
+ * swap, fills it, and publishes it by writing its position in the record
+ * last. The ring has two readers with their own tail, the serial port
+ * which takes the records as its FIFO empties, and the kernel worker
+ * which writes them to the screen. A record is only free once both went
+ * past it. A message finding the ring full is dropped and counted, the
+ * count is reported with the next message that fits. A message is
+ * formatted once in a line of its CPU, then copied into its record with
+ * interrupts disabled all along.
+ *
+ * Messages are written at once during boot, for errors and when printed
+ * with interrupts disabled outside of an interrupt handler, the caller
+ * may then hold a lock needed to wake the worker. */
+
+#define LOG_BUF_SIZE    16384
+#define LOG_LINE_SIZE   1024
+#define LOG_ORIGIN      LOG_BUF_SIZE    /* no record is at a position of 0 */
+
+#define LOG_PAD         0x01    /* fills the end of the ring */
+
+typedef struct
+{
+        volatile uint32_t pos;  /* where the record is, once written */
+        uint16_t len;           /* of the text following the record */
+        uint8_t  level;
+        uint8_t  flags;
+        uint32_t size;          /* up to the next record */
+        uint32_t reserved;
+} log_rec_t;
+
+#define rec_size(len)   ((sizeof(log_rec_t) + (len) + 15) & ~15)
+#define rec_at(pos)     ((log_rec_t *)&log_buf[(pos) % LOG_BUF_SIZE])
 
 static device_t *vga_driver;
 static device_t *com_driver;
 
-static uint8_t volatile log_lock = 0;
+static char log_buf[LOG_BUF_SIZE] __attribute__((aligned(16)));
+static char log_line[MAX_CPUS][LOG_LINE_SIZE];      /* formatted there first */
+static volatile uint32_t log_head = LOG_ORIGIN;     /* where the next record goes */
+static volatile uint32_t serial_tail = LOG_ORIGIN;  /* next record for the serial port */
+static volatile uint32_t vga_tail = LOG_ORIGIN;     /* next record for the screen */
+static volatile uint32_t log_dropped = 0;
+static int log_deferred = 0;
+static work_t log_work;
+
+static spinlock_t vga_lock = SPINLOCK_INIT("log vga");
+
+/* returns where the record went, 0 when the ring is full. Called with
+ * interrupts disabled, they stay so from the reservation to the
+ * publication: the readers stop at a record reserved but not published
+ * yet. */
+static uint32_t log_put(log_level_t level, const char *text, size_t len)
+{
+        uint32_t head, tail, pad, size, dropped;
+        char note[48];
+        size_t note_len = 0;
+        log_rec_t *rec;
+
+        /* the count is given back if this one is dropped as well */
+        dropped = __sync_lock_test_and_set(&log_dropped, 0);
+        if (dropped) {
+            note_len = snprintf(note, sizeof(note), "[log] %u messages dropped\n", dropped);
+        }
+        size = rec_size(note_len + len);
+
+        do {
+            head = log_head;
+            pad = (head % LOG_BUF_SIZE) + size > LOG_BUF_SIZE ?
+                  LOG_BUF_SIZE - head % LOG_BUF_SIZE : 0;
+            tail = (int32_t)(vga_tail - serial_tail) < 0 ? vga_tail : serial_tail;
+            if (head + pad + size - tail > LOG_BUF_SIZE) {
+                __sync_fetch_and_add(&log_dropped, dropped + 1);
+                return 0;
+            }
+        } while (!__sync_bool_compare_and_swap(&log_head, head, head + pad + size));
+
+        /* records are 16 bytes aligned, so is the padding */
+        if (pad) {
+            rec = rec_at(head);
+            rec->len = 0;
+            rec->size = pad;
+            rec->flags = LOG_PAD;
+            asm volatile ("" ::: "memory");
+            rec->pos = head;
+            head += pad;
+        }
+
+        rec = rec_at(head);
+        rec->level = level;
+        rec->flags = 0;
+        rec->size = size;
+        rec->len = note_len + len;
+        memcpy((char *)(rec + 1), note, note_len);
+        memcpy((char *)(rec + 1) + note_len, text, len);
+        asm volatile ("" ::: "memory");
+        rec->pos = head;
+
+        return head;
+}
+
+/* the next record after tail, 0 if it isn't written yet */
+static log_rec_t *log_peek(volatile uint32_t *tail)
+{
+        log_rec_t *rec;
+
+        for (;;) {
+            rec = rec_at(*tail);
+            if (*tail == log_head || rec->pos != *tail) {
+                return 0;
+            }
+            asm volatile ("" ::: "memory");
+            if (!(rec->flags & LOG_PAD)) {
+                return rec;
+            }
+            *tail += rec->size;
+        }
+}
+
+/* called by the serial port as its FIFO empties, with its lock held */
+static int log_refill_serial(void)
+{
+        log_rec_t *rec = log_peek(&serial_tail);
+
+        if (!rec || !serial_queue((uint8_t *)(rec + 1), rec->len)) {
+            return 0;
+        }
+        serial_tail += rec->size;
+        return 1;
+}
+
+/* interrupts are only disabled for one message at a time */
+static void log_flush_vga(void)
+{
+        log_rec_t *rec;
+
+        for (;;) {
+            irq_state_t irq_state = spin_lock_irqsave(&vga_lock);
+
+            rec = log_peek(&vga_tail);
+            if (!rec) {
+                spin_unlock_irqrestore(&vga_lock, irq_state);
+                return;
+            }
+            if (rec->level >= INFO) {
+                vga_driver->write((uint8_t *)(rec + 1), rec->len);
+            }
+            vga_tail += rec->size;
+
+            spin_unlock_irqrestore(&vga_lock, irq_state);
+        }
+}
+
+static void log_flush(void)
+{
+        serial_flush();
+        log_flush_vga();
+}
+
+static void log_drain(void *data)
+{
+        (void)data;
+        log_flush_vga();
+}
 
 void logging_init(device_t *vga, device_t *com)
 {
         vga_driver = vga;
         com_driver = com;
+        work_init(&log_work, log_drain, 0);
+        serial_set_refill(log_refill_serial);
+        spin_lock_register(&vga_lock);
+}
+
+/* the messages still queued and the next ones go to this screen */
+void logging_set_screen(device_t *screen)
+{
+        irq_state_t irq_state = spin_lock_irqsave(&vga_lock);
+        vga_driver = screen;
+        spin_unlock_irqrestore(&vga_lock, irq_state);
+}
+
+/* from now on the serial interrupt and the kernel worker write the
+ * messages out */
+void logging_defer(void)
+{
+        serial_start_irq();
+        log_deferred = 1;
+}
+
+/* the message goes to the drivers in pieces, an escape is never split */
+typedef struct
+{
+        char buf[64];
+        size_t len;
+        log_level_t level;
+} log_direct_t;
+
+static void direct_flush(log_direct_t *d)
+{
+        com_driver->write((uint8_t *)d->buf, d->len);
+        if (d->level >= INFO) {
+            vga_driver->write((uint8_t *)d->buf, d->len);
+        }
+        d->len = 0;
+}
+
+static void direct_sink(char c, void *data)
+{
+        log_direct_t *d = data;
+
+        if (d->len == sizeof(d->buf) ||
+            (d->len == sizeof(d->buf) - 1 && d->buf[d->len - 1] != '\033')) {
+            direct_flush(d);
+        }
+        d->buf[d->len++] = c;
+}
+
+/* nonzero once both readers went past the record at pos */
+static int log_written(uint32_t pos)
+{
+        return (int32_t)(serial_tail - pos) > 0 && (int32_t)(vga_tail - pos) > 0;
 }
 
 int kprintf(log_level_t level, const char *fmt, ...)
 {
-        char buf[1024];
         va_list args;
-        int n = 0;
+        char *line;
+        size_t len;
+        uint32_t pos;
+        int n, defer;
+        log_direct_t direct;
+
+        irq_state_t irq_state = irq_save();
+        defer = log_deferred && level < ERROR &&
+                ((irq_state & EFLAGS_IF) || in_interrupt());
+        irq_restore(irq_state);
 
+        if (!defer) {
+            /* what was queued before goes first */
+            log_flush();
+        }
+
+        /* the line is this CPU's until the record is published, only the
+         * boot CPU runs before the messages are deferred */
+        irq_state = irq_save();
+        line = log_line[log_deferred ? this_cpu()->id : 0];
         va_start(args, fmt);
-        n = vsprintf(buf, fmt, args);
+        n = vsnprintf(line, LOG_LINE_SIZE, fmt, args);
         va_end(args);
+        len = n < LOG_LINE_SIZE ? n : LOG_LINE_SIZE - 1;
+        pos = log_put(level, line, len);
+        irq_restore(irq_state);
 
-        //spin_lock(&log_lock);
-        
-        com_driver->write((uint8_t *)buf, strlen(buf));
-
-        if (level >= INFO) {
-            vga_driver->write((uint8_t *)buf, strlen(buf));
+        if (defer) {
+            if (pos) {
+                serial_kick();
+                schedule_work(&log_work);
+            }
+            return n;
         }
 
-        //spin_unlock(&log_lock);
+        if (pos) {
+            /* a record before this one may not be published yet, its
+             * writer has interrupts disabled until it is */
+            log_flush();
+            while (!log_written(pos)) {
+                asm volatile ("pause" ::: "memory");
+                log_flush();
+            }
+        } else {
+            /* still full, another CPU keeps filling it */
+            direct.len = 0;
+            direct.level = level;
+            va_start(args, fmt);
+            vcprintf(direct_sink, &direct, fmt, args);
+            va_end(args);
+            direct_flush(&direct);
+        }
 
         return n;
 }
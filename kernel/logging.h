@@ -2,6 +2,7 @@
 #define __KERNEL_LOGGING_H__
 
 #include <stdarg.h>
+#include <driver.h>
 
 typedef enum
 {
@@ -14,6 +15,8 @@ typedef enum
 } log_level_t;
 
 void logging_init();
+void logging_defer(void);
+void logging_set_screen(device_t *screen);
 
 int kprintf(log_level_t level, const char *fmt, ...);
 
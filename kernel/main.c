@@ -15,11 +15,19 @@
 #include <scheduler.h>
 #include <syscall.h>
 #include <mem_alloc.h>
+#include <smp.h>
+#include <spinlock.h>
+#include <workqueue.h>
+#include <ring.h>
+#include <vdso.h>
+#include <tracepoint.h>
+#include <fbcon.h>
 
 void print_mmap(const struct multiboot_info *mbi);
 
 static device_t *vga_driver;
 static device_t *com_driver;
+static device_t *kbd_driver;
 
 extern uint32_t kernel_voffset;
 extern uint32_t kernel_start;
@@ -31,15 +39,48 @@ size_t stack_size;
 
 unsigned char alph[] = "abcdefghijklmnopqrstuvwxyz";
 
+/* queues the call, making room in the ring if it is full */
+static void func1_queue(ring_t *ring, uint32_t num, uint32_t arg)
+{
+    ring_cqe_t cqe;
+
+    while (!ring_queue(ring, num, arg, 0, 0, 0)) {
+        ring_submit(ring);
+        while (ring_reap(ring, &cqe))
+            ;
+        syscall_thread_yield();
+    }
+}
+
 void func1(int off)
 {
-    syscall_vga_print_hex(off);
-    syscall_vga_print_str("ok\n");
+    ring_cqe_t cqe;
+    ring_t *ring = (ring_t *)syscall_ring_setup(RING_SQPOLL);
+
+    if (!ring) {
+        syscall_vga_print_hex(off);
+        syscall_vga_print_str("ok\n");
+        for (unsigned i = 0; i < 200000; ++i) {
+            if (i % 5000 == 0) 
+                syscall_vga_print_str("-");
+        }
+        syscall_vga_print_str("exit\n");
+        syscall_thread_exit();
+    }
+
+    /* the output costs one trap at most */
+    func1_queue(ring, SYSCALL_VGA_PRINT_HEX, off);
+    func1_queue(ring, SYSCALL_VGA_PRINT_STR, (uint32_t)" tid ");
+    func1_queue(ring, SYSCALL_VGA_PRINT_DEC, vdso_gettid());
+    func1_queue(ring, SYSCALL_VGA_PRINT_STR, (uint32_t)"ok\n");
     for (unsigned i = 0; i < 200000; ++i) {
         if (i % 5000 == 0) 
-            syscall_vga_print_str("-");
+            func1_queue(ring, SYSCALL_VGA_PRINT_STR, (uint32_t)"-");
     }
-    syscall_vga_print_str("exit\n");
+    func1_queue(ring, SYSCALL_VGA_PRINT_STR, (uint32_t)"exit\n");
+    ring_submit(ring);
+    while (ring_reap(ring, &cqe))
+        ;
     syscall_thread_exit();
 }
 
@@ -65,13 +106,51 @@ void func3(void)
 void reset()
 {
     for (;;) {
-        uint8_t c = keyboard_lastchar();
+        uint8_t c = keyboard_getchar();
         if (c == 'r') {
             arch_reset();
         }
     }
 }
 
+/* Lines typed on the serial port are commands: "trace <list>" turns
+ * tracepoints on or off, "list" shows them and "dump" prints the trace
+ * buffer. */
+static char serial_line[64];
+static size_t serial_line_len = 0;
+static work_t serial_work;
+
+static void serial_command(void *data)
+{
+    uint8_t c;
+
+    (void)data;
+    while (com_driver->read(&c, 1)) {
+        if (c != '\r' && c != '\n') {
+            if (serial_line_len < sizeof(serial_line) - 1) {
+                serial_line[serial_line_len++] = c;
+            }
+            continue;
+        }
+        serial_line[serial_line_len] = '\0';
+        if (strncmp(serial_line, "trace ", 6) == 0) {
+            tracepoint_command(serial_line + 6);
+        } else if (strcmp(serial_line, "list") == 0) {
+            tracepoint_list();
+        } else if (strcmp(serial_line, "dump") == 0) {
+            trace_dump(0);
+        } else if (serial_line_len) {
+            kprintf(WARNING, "[serial] Unknown command %s\n", serial_line);
+        }
+        serial_line_len = 0;
+    }
+}
+
+static void serial_rx(void)
+{
+    schedule_work(&serial_work);
+}
+
 char *memory_types[] =
 {
     "Available",
@@ -137,11 +216,33 @@ void main(uint32_t magic, struct multiboot_info *mbi,
 
     print_mmap(mbi);
 
+    device_t *fb_driver = fbcon_init(mbi);
+    if (fb_driver) {
+        vga_redirect(fb_driver);
+        logging_set_screen(fb_driver);
+    }
+
     syscall_init();
+    vdso_init();
+    irq_stack_init(this_cpu());
+    trace_init();
+    const char *cmdline = (mbi->flags & MULTIBOOT_CMDLINE) ?
+                          (const char *)(mbi->cmd_line + (uint32_t)&kernel_voffset) : 0;
+    tracepoint_init(cmdline);
+    serial_setup(cmdline);
+
+    arch_init_apic();
 
     scheduling_init();
 
-    keyboard_init();
+    workqueue_init();
+    logging_defer();
+    work_init(&serial_work, serial_command, 0);
+    serial_set_rx(serial_rx);
+
+    smp_init();
+
+    kbd_driver = keyboard_init();
 
     process_t *proc1 = create_process("Process 1", 1);
     process_t *proc2 = create_process("Process 2", 1);
@@ -185,12 +286,26 @@ void main(uint32_t magic, struct multiboot_info *mbi,
         off += 2;
         off %= (60 * (25-2));
         */
-        char c = keyboard_lastchar();
+        /* sleeps until a key is pressed */
+        char c = 0;
+        kbd_driver->read((uint8_t *)&c, 1);
         if (c == 'u') {
             create_thread(proc1, func1, (void *)5, 1, 1, 0);
         } else if (c == 'k') {
             create_thread(proc1, func2, (void *)off, 1, 0, 0);
             off += 2;
+        } else if (c == 's') {
+            sched_dump_stats();
+        } else if (c == 'l') {
+            lock_dump_stats();
+        } else if (c == 'i') {
+            irq_dump_stats();
+        } else if (c == 't') {
+            trace_dump(0);
+        } else if (c == 'T') {
+            trace_dump(1);
+        } else if (c == 'p') {
+            tracepoint_list();
         }
         ++k;
     }
@@ -2,6 +2,11 @@
 #include <paging.h>
 #include <logging.h>
 #include <mem_alloc.h>
+#include <tracepoint.h>
+
+DEFINE_TRACEPOINT(mem, alloc);
+DEFINE_TRACEPOINT(mem, expand);
+DEFINE_TRACEPOINT(mem, free);
 
 #define MAGIC                       (uint32_t)0xa1b2c3d4 /* last bit is ignored */
 #define set_magic(block)            ((block)->magic = ((MAGIC & ~(1 << 0)) | ((block)->magic & (1 << 0))))
@@ -159,13 +164,15 @@ void *alloc(const size_t size, size_t alignment, allocator_t *allocator)
     /* space to store user data and block metadata */
     size_t requested_size = get_block_size(size);
 
+    tracepoint(mem, alloc, "size %x align %x", size, alignment);
+
     /* get a block of size "size" or bigger */
     alignment = alignment == 0 ? 1 : alignment; /* must be > 0 for best fit search */
     struct alloc_args args = { alignment, 0 }; /* no address matching */
     rb_node_t *node = remove_rbnode(&allocator->mem_tree, (void *)requested_size, &args); 
 
     if (!node) {
-        DBPRINT("- \033\012Expansion\033\017\n");
+        tracepoint(mem, expand, "heap end %x grows by %x", allocator->end_address, requested_size);
         /* expand the heap */
         uintptr_t old_end_address = allocator->end_address;
         expand(allocator->end_address + requested_size, allocator);
@@ -280,7 +287,7 @@ void free(void *p, allocator_t *allocator)
     /* get node from user pointer */
     alloc_header_t *block = user_to_block(p);
 
-    DBPRINT("magic: %x\n", block->magic);
+    tracepoint(mem, free, "block %x magic %x", block, block->magic);
     assert(check_magic(block) && "Wrong header magic");
 
     /* don't free a node already freed */
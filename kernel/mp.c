@@ -0,0 +1,232 @@
+#include <system.h>
+#include <string.h>
+#include <lapic.h>
+#include <mp.h>
+
+/* MultiProcessor Specification tables, left by the BIOS in low memory.
+ * They list the processors, the IO-APICs and how ISA IRQs are wired. */
+
+#define MP_FLOATING_SIG     0x5f504d5f  /* "_MP_" */
+#define MP_CONFIG_SIG       0x504d4350  /* "PCMP" */
+
+#define MP_PROCESSOR        0
+#define MP_BUS              1
+#define MP_IOAPIC           2
+#define MP_IOINTERRUPT      3
+
+#define MP_CPU_ENABLED      (1 << 0)
+#define MP_IOAPIC_ENABLED   (1 << 0)
+#define MP_FEATURE_IMCR     (1 << 7)
+#define MP_INT_VECTORED     0
+
+#define MP_POLARITY_LOW     0x3
+#define MP_TRIGGER_LEVEL    0x3
+
+#define PHYS_TO_VIRT(addr)  ((uintptr_t)(addr) + (uintptr_t)&kernel_voffset)
+#define LOW_MEMORY_END      0x100000
+
+typedef struct
+{
+    uint32_t signature;
+    uint32_t config;        /* physical address of the configuration table */
+    uint8_t  length;        /* in 16 bytes units */
+    uint8_t  revision;
+    uint8_t  checksum;
+    uint8_t  features[5];   /* features[0] != 0: default configuration, no table */
+} __attribute__((packed)) mp_floating_t;
+
+typedef struct
+{
+    uint32_t signature;
+    uint16_t length;
+    uint8_t  revision;
+    uint8_t  checksum;
+    char     oem[8];
+    char     product[12];
+    uint32_t oem_table;
+    uint16_t oem_length;
+    uint16_t entries;
+    uint32_t lapic;         /* physical address of the local APICs */
+    uint16_t ext_length;
+    uint8_t  ext_checksum;
+    uint8_t  reserved;
+} __attribute__((packed)) mp_config_t;
+
+typedef struct
+{
+    uint8_t  type;
+    uint8_t  apic_id;
+    uint8_t  apic_version;
+    uint8_t  flags;
+    uint32_t signature;
+    uint32_t features;
+    uint32_t reserved[2];
+} __attribute__((packed)) mp_processor_t;
+
+typedef struct
+{
+    uint8_t  type;
+    uint8_t  bus_id;
+    char     name[6];
+} __attribute__((packed)) mp_bus_t;
+
+typedef struct
+{
+    uint8_t  type;
+    uint8_t  apic_id;
+    uint8_t  apic_version;
+    uint8_t  flags;
+    uint32_t address;
+} __attribute__((packed)) mp_ioapic_t;
+
+typedef struct
+{
+    uint8_t  type;
+    uint8_t  irq_type;
+    uint16_t flags;         /* 0-1: polarity, 2-3: trigger mode */
+    uint8_t  src_bus;
+    uint8_t  src_irq;
+    uint8_t  dst_apic;
+    uint8_t  dst_pin;
+} __attribute__((packed)) mp_interrupt_t;
+
+extern uint32_t kernel_voffset;
+
+mp_info_t mp_info;
+
+static uint8_t checksum(const void *p, size_t length)
+{
+    const uint8_t *bytes = (const uint8_t *)p;
+    uint8_t sum = 0;
+
+    while (length--) {
+        sum += *bytes++;
+    }
+    return sum;
+}
+
+static mp_floating_t *mp_scan(uintptr_t start, size_t length)
+{
+    uintptr_t addr;
+
+    for (addr = start; addr + sizeof(mp_floating_t) <= start + length; addr += 16) {
+        mp_floating_t *mp = (mp_floating_t *)PHYS_TO_VIRT(addr);
+        if (mp->signature == MP_FLOATING_SIG && checksum(mp, mp->length * 16) == 0) {
+            return mp;
+        }
+    }
+    return 0;
+}
+
+/* the floating pointer is in the first KiB of the EBDA, the last KiB of
+ * base memory or the BIOS ROM */
+static mp_floating_t *mp_find(void)
+{
+    uintptr_t ebda = *(uint16_t *)PHYS_TO_VIRT(0x40e) << 4;
+    uintptr_t base = *(uint16_t *)PHYS_TO_VIRT(0x413) * 1024;
+    mp_floating_t *mp = 0;
+
+    if (ebda) {
+        mp = mp_scan(ebda, 1024);
+    }
+    if (!mp) {
+        mp = mp_scan(base - 1024, 1024);
+    }
+    if (!mp) {
+        mp = mp_scan(0xf0000, 0x10000);
+    }
+    return mp;
+}
+
+static mp_config_t *mp_find_config(mp_floating_t *mp)
+{
+    if (mp->features[0] || !mp->config) {
+        return 0;
+    }
+    /* only the first MiB is mapped for sure */
+    if (mp->config + sizeof(mp_config_t) > LOW_MEMORY_END) {
+        kprintf(WARNING, "[mp] Configuration table out of reach\n");
+        return 0;
+    }
+
+    mp_config_t *config = (mp_config_t *)PHYS_TO_VIRT(mp->config);
+    if (config->signature != MP_CONFIG_SIG ||
+        mp->config + config->length > LOW_MEMORY_END ||
+        checksum(config, config->length) != 0) {
+        return 0;
+    }
+    return config;
+}
+
+static void mp_add_interrupt(const mp_interrupt_t *irq, uint32_t isa_buses)
+{
+    if (irq->irq_type != MP_INT_VECTORED || irq->src_bus >= 32 ||
+        !(isa_buses & (1 << irq->src_bus)) || irq->src_irq >= MP_ISA_IRQS ||
+        irq->dst_apic != mp_info.ioapic_id) {
+        return;
+    }
+
+    /* conforming ISA interrupts are edge triggered, active high */
+    mp_info.isa_pin[irq->src_irq] = irq->dst_pin;
+    mp_info.isa_flags[irq->src_irq] =
+        ((irq->flags & 0x3) == MP_POLARITY_LOW ? MP_IRQ_ACTIVE_LOW : 0) |
+        (((irq->flags >> 2) & 0x3) == MP_TRIGGER_LEVEL ? MP_IRQ_LEVEL : 0);
+}
+
+int mp_init(void)
+{
+    mp_floating_t *mp = mp_find();
+    mp_config_t *config;
+    uint32_t isa_buses = 0;
+    uint8_t *entry;
+    uint32_t i;
+
+    if (!mp || !(config = mp_find_config(mp))) {
+        return -1;
+    }
+
+    memset(&mp_info, 0, sizeof(mp_info));
+    mp_info.lapic_base = config->lapic ? config->lapic : LAPIC_DEFAULT_BASE;
+    mp_info.imcr = (mp->features[1] & MP_FEATURE_IMCR) != 0;
+    for (i = 0; i < MP_ISA_IRQS; ++i) {
+        mp_info.isa_pin[i] = i;
+    }
+
+    /* buses and IO-APICs come before the interrupts using them */
+    entry = (uint8_t *)(config + 1);
+    for (i = 0; i < config->entries; ++i) {
+        switch (*entry) {
+        case MP_PROCESSOR: {
+            mp_processor_t *processor = (mp_processor_t *)entry;
+            if ((processor->flags & MP_CPU_ENABLED) && mp_info.num_cpus < MP_MAX_CPUS) {
+                mp_info.cpu_apic_ids[mp_info.num_cpus++] = processor->apic_id;
+            }
+            entry += sizeof(mp_processor_t);
+            continue;
+        }
+        case MP_BUS: {
+            mp_bus_t *bus = (mp_bus_t *)entry;
+            if (bus->bus_id < 32 && strncmp(bus->name, "ISA", 3) == 0) {
+                isa_buses |= 1 << bus->bus_id;
+            }
+            break;
+        }
+        case MP_IOAPIC: {
+            mp_ioapic_t *ioapic = (mp_ioapic_t *)entry;
+            if ((ioapic->flags & MP_IOAPIC_ENABLED) && !mp_info.ioapic_base) {
+                mp_info.ioapic_id = ioapic->apic_id;
+                mp_info.ioapic_base = ioapic->address;
+            }
+            break;
+        }
+        case MP_IOINTERRUPT:
+            mp_add_interrupt((mp_interrupt_t *)entry, isa_buses);
+            break;
+        }
+        entry += 8;
+    }
+
+    kprintf(INFO, "[mp] %u CPU(s), local APIC at %#010x, IO-APIC at %#010x\n",
+            mp_info.num_cpus, mp_info.lapic_base, mp_info.ioapic_base);
+    return 0;
+}
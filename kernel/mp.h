@@ -0,0 +1,29 @@
+#ifndef __KERNEL_MP_H__
+#define __KERNEL_MP_H__
+
+#include <types.h>
+
+#define MP_MAX_CPUS         16
+#define MP_ISA_IRQS         16
+
+#define MP_IRQ_ACTIVE_LOW   (1 << 0)
+#define MP_IRQ_LEVEL        (1 << 1)
+
+/* what the BIOS told us about the processors and interrupt routing */
+typedef struct
+{
+    uintptr_t lapic_base;
+    uint32_t  num_cpus;
+    uint8_t   cpu_apic_ids[MP_MAX_CPUS];    /* enabled processors, BSP included */
+    uint8_t   ioapic_id;
+    uintptr_t ioapic_base;                  /* first IO-APIC, 0 if there is none */
+    uint8_t   isa_pin[MP_ISA_IRQS];         /* IO-APIC input of each ISA IRQ */
+    uint8_t   isa_flags[MP_ISA_IRQS];       /* MP_IRQ_* */
+    int       imcr;                         /* the PIC must be disconnected through the IMCR */
+} mp_info_t;
+
+extern mp_info_t mp_info;
+
+int mp_init(void);
+
+#endif
@@ -6,9 +6,14 @@
 #define MULTIBOOT_MAGIC         0x2badb002
 #define MULTIBOOT_MEMINFO       (1 << 0)
 #define MULTIBOOT_BOOTDEV       (1 << 1)
+#define MULTIBOOT_CMDLINE       (1 << 2)
 #define MULTIBOOT_MODS          (1 << 3)
 #define MULTIBOOT_MMAP          (1 << 6)
 #define MULTIBOOT_LOADER        (1 << 9)
+#define MULTIBOOT_FRAMEBUFFER   (1 << 12)
+
+#define MULTIBOOT_FB_RGB        1
+#define MULTIBOOT_FB_TEXT       2   /* the VGA text mode */
 
 struct multiboot_info
 {
@@ -36,6 +41,18 @@ struct multiboot_info
         uint16_t vbe_interface_seg;
         uint16_t vbe_interface_off;
         uint16_t vbe_interface_len;
+        uint64_t framebuffer_addr;
+        uint32_t framebuffer_pitch;     /* bytes per line */
+        uint32_t framebuffer_width;
+        uint32_t framebuffer_height;
+        uint8_t  framebuffer_bpp;
+        uint8_t  framebuffer_type;
+        uint8_t  red_position;          /* for the RGB type */
+        uint8_t  red_size;
+        uint8_t  green_position;
+        uint8_t  green_size;
+        uint8_t  blue_position;
+        uint8_t  blue_size;
 } __attribute__((packed));
 
 typedef struct __attribute__((packed))
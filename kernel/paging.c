@@ -3,6 +3,13 @@
 #include <logging.h>
 #include <string.h>
 #include <kheap.h>
+#include <smp.h>
+#include <tracepoint.h>
+#include <cpufeature.h>
+
+DEFINE_TRACEPOINT(paging, frame);
+DEFINE_TRACEPOINT(paging, fault);
+DEFINE_TRACEPOINT(paging, clone);
 
 #define BIT_TO_IDX(bit) ((bit) / 32)
 #define BIT_TO_OFF(bit) ((bit) % 32)
@@ -18,12 +25,18 @@ static uint32_t *frames;
 static uint32_t nframes;
 static uint32_t used_frames;
 
-page_dir_t *current_directory = 0;
 page_dir_t *kernel_directory = 0;
 
 extern uintptr_t placement_address;
 extern allocator_t *kheap;
 
+#define PAT_WC      0x01
+#define CR0_NW      (1 << 29)   /* not write-through */
+#define CR0_CD      (1 << 30)   /* cache disable */
+#define CR4_PGE     (1 << 7)    /* global pages */
+
+static int has_pat = 0;
+
 inline int test_frame(uint32_t frame)
 {
     return (frames[BIT_TO_IDX(frame)] & (1 << BIT_TO_OFF(frame)));
@@ -119,6 +132,7 @@ void alloc_page(pte_t *page, int is_kernel, int is_writeable)
         return;
     }
     set_frame(frame);
+    tracepoint(paging, frame, "frame %x for pte %x", frame, page);
 
     /* map the frame to the page */
     page->frame = frame;
@@ -189,6 +203,60 @@ void paging_init(uint32_t mem_size)
     used_frames = 0;
 
     kprintf(INFO, "[paging] Frames bitmap located at %#010x\n", frames);
+
+    paging_init_pat();
+}
+
+/* The PAT entry selected by the write-through bit alone becomes write
+ * combining, no page is mapped with it before. The frame buffer is mapped
+ * that way so the CPU sends the pixels out in bursts. */
+void paging_init_pat(void)
+{
+    has_pat = cpu_has(CPU_PAT);
+    paging_init_pat_ap();
+}
+
+/* both the TLBs and the caches may hold the old memory types */
+static void flush_caches_and_tlb(void)
+{
+    uint32_t cr3, cr4;
+
+    asm volatile ("wbinvd" ::: "memory");
+    asm volatile ("mov %%cr4, %0" : "=r"(cr4));
+    if (cr4 & CR4_PGE) {
+        /* the global pages go as well */
+        asm volatile ("mov %0, %%cr4" :: "r"(cr4 & ~CR4_PGE) : "memory");
+        asm volatile ("mov %0, %%cr4" :: "r"(cr4) : "memory");
+    } else {
+        asm volatile ("mov %%cr3, %0\n"
+                      "mov %0, %%cr3" : "=r"(cr3) :: "memory");
+    }
+}
+
+/* the PAT is per CPU, each of them goes through this. It is changed the
+ * way the SDM asks for the MTRRs: with interrupts disabled, the caches
+ * off and flushed along with the TLB, before and after the write. */
+void paging_init_pat_ap(void)
+{
+    uint64_t pat;
+    uint32_t cr0;
+
+    if (!has_pat) {
+        return;
+    }
+
+    irq_state_t irq_state = irq_save();
+    asm volatile ("mov %%cr0, %0" : "=r"(cr0));
+    asm volatile ("mov %0, %%cr0" :: "r"((cr0 | CR0_CD) & ~CR0_NW) : "memory");
+    flush_caches_and_tlb();
+
+    pat = rdmsr(MSR_PAT);
+    pat = (pat & ~0xff00ULL) | (PAT_WC << 8);
+    wrmsr(MSR_PAT, pat);
+
+    flush_caches_and_tlb();
+    asm volatile ("mov %0, %%cr0" :: "r"(cr0) : "memory");
+    irq_restore(irq_state);
 }
 
 void paging_finalize()
@@ -233,8 +301,7 @@ void paging_finalize()
     }
     
     /* initialize the kernel heap */
-    kheap = create_mem_allocator(KHEAP_START, KHEAP_START + KHEAP_INITIAL_SIZE, 
-            HEAP_MIN_SIZE, HEAP_MAX_SIZE, 0, 0, current_directory);
+    kheap_init();
 
     //switch_page_directory(clone_page_directory(kernel_directory));
 
@@ -249,7 +316,7 @@ page_dir_t *switch_page_directory(page_dir_t *dir)
     if (!dir) {
         return 0;
     }
-    current_directory = dir;
+    this_cpu()->page_dir = dir;
 
     page_dir_t *old_dir;
     asm volatile ("mov %%cr3, %0\n" : "=r"(old_dir));
@@ -258,6 +325,47 @@ page_dir_t *switch_page_directory(page_dir_t *dir)
     return old_dir;
 }
 
+/* map a page of device registers at the same virtual address, uncached.
+ * Devices live high enough to fall in kernel space, whose page tables
+ * are shared by every directory. */
+void *paging_map_mmio(uintptr_t phys)
+{
+    uintptr_t virt = phys & ~(FRAME_SIZE - 1);
+    assert(virt >= (uintptr_t)&kernel_voffset);
+
+    pte_t *page = get_page(virt, 1, kernel_directory);
+    map_page(page, 1, 1, virt);
+    page->cache_disabled = 1;
+    page->write_through = 1;
+    invalidate_page_tables_at(virt);
+
+    return (void *)phys;
+}
+
+/* Maps size bytes at FB_WINDOW whatever the physical address, the kernel
+ * or its heap may be mapped there. Write combining if the CPU has a PAT
+ * and uncached otherwise. Returns 0 if it doesn't fit in the window. */
+void *paging_map_fb(uintptr_t phys, size_t size)
+{
+    uintptr_t base = phys & ~(FRAME_SIZE - 1);
+    uintptr_t len = size + (phys - base);
+    uintptr_t off;
+
+    if (size == 0 || len > FB_WINDOW_SIZE || base + len - 1 < base) {
+        return 0;
+    }
+
+    for (off = 0; off < len; off += FRAME_SIZE) {
+        pte_t *page = get_page(FB_WINDOW + off, 1, kernel_directory);
+        map_page(page, 1, 1, base + off);
+        page->write_through = 1;
+        page->cache_disabled = !has_pat;
+        invalidate_page_tables_at(FB_WINDOW + off);
+    }
+
+    return (void *)(FB_WINDOW + (phys - base));
+}
+
 void invalidate_page_tables_at(uintptr_t addr)
 {
     asm volatile ("movl %0, %%eax\n"
@@ -310,6 +418,7 @@ page_dir_t *clone_page_directory(page_dir_t *dir)
     page_dir_t *clone = (page_dir_t *)kmalloc_ap(sizeof(page_dir_t), &phys);
     memset(clone, 0, sizeof(page_dir_t));
     clone->entries_phys_addr = phys;
+    tracepoint(paging, clone, "%x -> %x", dir, clone);
 
     /* clone the page tables */
     for (int i = 0; i < 1024; ++i) {
@@ -341,6 +450,7 @@ void page_fault(registers_t *regs)
     irq_disable();
     uint32_t faulting_address;
     asm volatile("mov %%cr2, %0" : "=r" (faulting_address));
+    tracepoint(paging, fault, "at %x eip %x error %x", faulting_address, regs->eip, regs->err_code);
 
     int present  = !(regs->err_code & (1 << 0)); // page not present
     int rw       = regs->err_code & (1 << 1);    // write operation
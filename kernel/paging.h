@@ -5,6 +5,11 @@
 #include <types.h>
 
 #define FRAME_SIZE 0x1000
+#define MSR_PAT    0x277
+
+/* virtual window of the framebuffer, above the kernel heap */
+#define FB_WINDOW       0xe0000000
+#define FB_WINDOW_SIZE  0x04000000
 
 /* page table entry */
 typedef struct
@@ -72,6 +77,10 @@ void paging_mark_reserved(uintptr_t address);
 
 page_dir_t *switch_page_directory(page_dir_t *dir);
 void invalidate_page_tables_at(uintptr_t addr);
+void *paging_map_mmio(uintptr_t phys);
+void *paging_map_fb(uintptr_t phys, size_t size);
+void paging_init_pat(void);
+void paging_init_pat_ap(void);
 page_dir_t *clone_page_directory(page_dir_t *dir);
 
 void page_fault(registers_t *regs);
@@ -141,6 +141,11 @@ uint32_t pic_get_bad_irqs()
     return bad_irqs;
 }
 
+uint16_t pic_get_mask()
+{
+    return inb(PIC1_DATA) | inb(PIC2_DATA) << 8;
+}
+
 static uint16_t pic_get_irq_reg(uint16_t command)
 {
     outb(PIC1_CTRL, command);
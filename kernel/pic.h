@@ -33,5 +33,6 @@ void pic_restore();
 
 uint8_t pic_acknowledge(pic_index_t irq);
 uint32_t pic_get_bad_irqs();
+uint16_t pic_get_mask();
 
 #endif
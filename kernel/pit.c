@@ -1,7 +1,9 @@
 #include <system.h>
+#include <spinlock.h>
 #include <pit.h>
 #include <pic.h>
 #include <logging.h>
+#include <timer.h>
 
 #define PIT_MAX_FREQ                    1193182
 #define PIT_DATA0                       0x40
@@ -19,12 +21,74 @@
 #define PIT_OCW_COUNTER1                0x40
 #define PIT_OCW_COUNTER2                0x80
 
+#define PIT_OCW_LATCH                   0x00
+#define PIT_OCW_READ_BACK               0xc0    /* latches count and status */
+#define PIT_READ_BACK_COUNTER0          0x02
+#define PIT_STATUS_OUT                  0x80    /* set once mode 0 reaches terminal count */
+#define PIT_STATUS_NULL_COUNT           0x40    /* the new count isn't loaded yet */
+#define PIT_MAX_COUNT                   0xffff
+
 static volatile uint32_t ticks = 0;
+static uint32_t divisor = 0;        /* PIT counts per tick */
+static uint32_t oneshot_count = 0;  /* counts programmed in one-shot mode, 0 if periodic */
+static uint32_t residue = 0;        /* counts elapsed that don't make a full tick yet */
+static spinlock_t pit_lock = SPINLOCK_INIT("pit");  /* any CPU may read or program the counter */
+
+/* counts elapsed since the one-shot countdown was programmed. Once the
+ * terminal count is reached the counter wraps to 0xffff and keeps going,
+ * only the OUT pin tells that it fired. The read-back command latches the
+ * status and the count together. */
+static uint32_t pit_oneshot_elapsed(void)
+{
+        uint8_t status;
+        uint32_t count;
+
+        outb(PIT_CTRL, PIT_OCW_READ_BACK | PIT_READ_BACK_COUNTER0);
+        status = inb(PIT_DATA0);
+        count = inb(PIT_DATA0);
+        count |= inb(PIT_DATA0) << 8;
+
+        if (status & PIT_STATUS_OUT) {
+                return oneshot_count;
+        }
+        if (status & PIT_STATUS_NULL_COUNT) {
+                return 0;
+        }
+        return count > oneshot_count ? oneshot_count : oneshot_count - count;
+}
+
+/* fold the time spent in one-shot mode into the tick count */
+static void pit_catch_up(uint32_t elapsed)
+{
+        residue += elapsed;
+        ticks += residue / divisor;
+        residue %= divisor;
+}
+
+static void pit_program(uint8_t mode, uint32_t count)
+{
+        outb(PIT_CTRL, PIT_OCW_COUNTER0 |
+                       PIT_OCW_BINCOUNT_BINARY |
+                       PIT_OCW_RL_LSB_THEN_MSB |
+                       mode);
+
+        outb(PIT_DATA0, count & 0xff); /* send lower byte */
+        outb(PIT_DATA0, (count >> 8) & 0xff);   /* send upper byte */
+}
 
 static void pit_handler(registers_t *r)
 {
         (void)r;
-        ++ticks;
+        spin_lock(&pit_lock);
+        if (oneshot_count) {
+                /* the countdown expired and the PIT stays silent until
+                 * it is programmed again */
+                pit_catch_up(oneshot_count);
+                oneshot_count = 0;
+        } else {
+                ++ticks;
+        }
+        spin_unlock(&pit_lock);
 
         //if (ticks % 100 == 0)
         //    kprintf(DEBUG, ".");
@@ -35,25 +99,68 @@ void pit_init(uint32_t freq)
         if (freq == 0)
                 return;
 
-        uint32_t divisor = (uint16_t)(PIT_MAX_FREQ / freq);
+        divisor = (uint16_t)(PIT_MAX_FREQ / freq);
 
-        outb(PIT_CTRL, PIT_OCW_COUNTER0 |
-                       PIT_OCW_BINCOUNT_BINARY |
-                       PIT_OCW_RL_LSB_THEN_MSB |
-                       PIT_OCW_MODE_SQUARE_WAVE);
-
-        outb(PIT_DATA0, divisor & 0xff); /* send lower byte */
-        outb(PIT_DATA0, (divisor >> 8) & 0xff);   /* send upper byte */
+        pit_program(PIT_OCW_MODE_SQUARE_WAVE, divisor);
 
         ticks = 0;
 
         attach_interrupt_handler(IRQ(IRQ_TIMER), pit_handler);
-        pic_enable_irq(IRQ_TIMER);
+        enable_irq(IRQ_TIMER);
+}
+
+uint32_t pit_oneshot(uint32_t nticks)
+{
+        irq_state_t irq_state = spin_lock_irqsave(&pit_lock);
+
+        if (oneshot_count) {
+                pit_catch_up(pit_oneshot_elapsed());
+        }
+
+        if (nticks == 0) {
+                nticks = 1;
+        }
+        if (nticks > PIT_MAX_COUNT / divisor) {
+                nticks = PIT_MAX_COUNT / divisor;
+        }
+        /* the partial tick already elapsed is not waited for again */
+        oneshot_count = nticks * divisor - residue;
+        pit_program(PIT_OCW_MODE_TERMINAL_COUNT, oneshot_count);
+
+        spin_unlock_irqrestore(&pit_lock, irq_state);
+        return nticks;
+}
+
+void pit_periodic(void)
+{
+        irq_state_t irq_state = spin_lock_irqsave(&pit_lock);
+
+        if (oneshot_count) {
+                pit_catch_up(pit_oneshot_elapsed());
+                oneshot_count = 0;
+                pit_program(PIT_OCW_MODE_SQUARE_WAVE, divisor);
+        }
+
+        spin_unlock_irqrestore(&pit_lock, irq_state);
 }
 
 uint32_t pit_get_ticks()
 {
-        return ticks;
+        uint32_t now;
+
+        if (!oneshot_count) {
+                return ticks;
+        }
+
+        /* the tick count is only updated when the one-shot expires */
+        irq_state_t irq_state = spin_lock_irqsave(&pit_lock);
+        now = ticks;
+        if (oneshot_count) {
+                now += (residue + pit_oneshot_elapsed()) / divisor;
+        }
+        spin_unlock_irqrestore(&pit_lock, irq_state);
+
+        return now;
 }
 
 void pit_set_ticks(uint32_t val)
@@ -61,3 +168,11 @@ void pit_set_ticks(uint32_t val)
         ticks = val;
 }
 
+clock_event_t pit_clock =
+{
+        .name      = "PIT",
+        .vector    = IRQ(IRQ_TIMER),
+        .get_ticks = pit_get_ticks,
+        .oneshot   = pit_oneshot,
+        .periodic  = pit_periodic
+};
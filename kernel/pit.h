@@ -2,8 +2,13 @@
 #define __KERNEL_PIT_H__
 
 #include <types.h>
+#include <timer.h>
+
+extern clock_event_t pit_clock;
 
 void pit_init(uint32_t freq);
+uint32_t pit_oneshot(uint32_t nticks);
+void pit_periodic(void);
 uint32_t pit_get_ticks();
 void pit_set_ticks(uint32_t val);
 
@@ -3,9 +3,10 @@
 #include <paging.h>
 #include <string.h>
 #include <process.h>
+#include <smp.h>
+#include <vdso.h>
 
 extern page_dir_t *kernel_directory;
-extern page_dir_t *current_directory;
 
 static uint32_t request_process_id()
 {
@@ -24,10 +25,12 @@ process_t *create_process(const char name[64], uint32_t priority)
     }
 
     strncpy(process->name, name, sizeof(name));
-    process->page_dir = clone_page_directory(current_directory);
+    process->page_dir = clone_page_directory(this_cpu()->page_dir);
+    vdso_map(process->page_dir);
 
     process->id = request_process_id();
     process->priority = priority;
+    process->ring = 0;
 
     return process;
 }
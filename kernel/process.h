@@ -11,6 +11,7 @@
 struct thread;
 struct process;
 struct page_dir;
+struct ring_ctx;
 
 typedef struct process
 {
@@ -22,6 +23,7 @@ typedef struct process
     struct process  *next;
     struct process  *prev;
     struct thread   *threads;
+    struct ring_ctx *ring;      /* system call ring, see ring.h */
 } process_t;
 
 process_t *create_process(const char name[64], uint32_t priority);
@@ -0,0 +1,165 @@
+#include <system.h>
+#include <spinlock.h>
+#include <kheap.h>
+#include <paging.h>
+#include <string.h>
+#include <process.h>
+#include <thread.h>
+#include <scheduler.h>
+#include <timer.h>
+#include <syscall.h>
+#include <ring.h>
+
+/* The kernel keeps its own copy of the indices it owns and only writes
+ * them out, what the process puts in the page is never trusted further
+ * than masking the index. */
+
+static spinlock_t ring_setup_lock = SPINLOCK_INIT("ring setup");
+
+static int ring_dispatch(const ring_sqe_t *sqe)
+{
+    /* exiting from the ring or entering it again makes no sense */
+    if (sqe->num == SYSCALL_THREAD_EXIT || sqe->num == SYSCALL_RING_SETUP ||
+        sqe->num == SYSCALL_RING_ENTER) {
+        return -1;
+    }
+    return syscall_dispatch(sqe->num, sqe->args[0], sqe->args[1], sqe->args[2],
+                            sqe->args[3], sqe->args[4]);
+}
+
+/* runs the queued calls, returns how many. Stops when the completion ring
+ * is full, and returns 0 if another thread is already running them. */
+static int ring_process(ring_ctx_t *ctx)
+{
+    ring_t *ring = ctx->ring;
+    ring_sqe_t sqe;
+    ring_cqe_t *cqe;
+    int n = 0;
+
+    if (!spin_trylock(&ctx->lock)) {
+        return 0;
+    }
+    while (ctx->sq_head != ring->sq_tail) {
+        if (ctx->cq_tail - ring->cq_head >= RING_ENTRIES) {
+            break;
+        }
+        /* the process may change the entry while it is being run */
+        sqe = ring->sq[ctx->sq_head & RING_MASK];
+        ring_barrier();
+
+        cqe = &ring->cq[ctx->cq_tail & RING_MASK];
+        cqe->user_data = sqe.user_data;
+        cqe->res = ring_dispatch(&sqe);
+        ring_barrier();
+        ring->cq_tail = ++ctx->cq_tail;
+        ring->sq_head = ++ctx->sq_head;
+        ++n;
+    }
+    spin_unlock(&ctx->lock);
+    return n;
+}
+
+/* keeps running the submissions while there are some, and sleeps until
+ * the next ring_enter once the ring stayed empty for a while */
+static void ring_poll(ring_ctx_t *ctx)
+{
+    ring_t *ring = ctx->ring;
+    uint32_t last = timer_get_ticks();
+
+    ctx->poller = get_current_thread();
+
+    for (;;) {
+        if (ring_process(ctx)) {
+            last = timer_get_ticks();
+            continue;
+        }
+        if (timer_get_ticks() - last < ms_to_ticks(RING_POLL_IDLE)) {
+            thread_yield();
+            continue;
+        }
+
+        __sync_fetch_and_or(&ring->flags, RING_NEED_WAKEUP);
+        __sync_synchronize();
+        if (ring->sq_tail == ctx->sq_head) {
+            /* a wake-up between the check and here isn't lost */
+            block_thread();
+        }
+        __sync_fetch_and_and(&ring->flags, ~RING_NEED_WAKEUP);
+        last = timer_get_ticks();
+    }
+}
+
+/* maps the calling process' ring, creating it the first time */
+ring_t *ring_setup(uint32_t flags)
+{
+    process_t *process = get_current_thread()->process;
+    ring_ctx_t *ctx;
+    pte_t *page;
+
+    if (!process) {
+        return 0;   /* kernel threads call the kernel directly */
+    }
+
+    irq_state_t irq_state = spin_lock_irqsave(&ring_setup_lock);
+
+    if (process->ring) {
+        spin_unlock_irqrestore(&ring_setup_lock, irq_state);
+        return (ring_t *)RING_USER_ADDR;
+    }
+
+    ctx = (ring_ctx_t *)kmalloc(sizeof(ring_ctx_t));
+    if (!ctx) {
+        spin_unlock_irqrestore(&ring_setup_lock, irq_state);
+        return 0;
+    }
+    memset(ctx, 0, sizeof(ring_ctx_t));
+    ctx->ring = (ring_t *)kmalloc_ap(FRAME_SIZE, &ctx->phys);
+    if (!ctx->ring) {
+        kfree(ctx);
+        spin_unlock_irqrestore(&ring_setup_lock, irq_state);
+        return 0;
+    }
+    memset(ctx->ring, 0, FRAME_SIZE);
+    ctx->flags = flags & RING_SQPOLL;
+    ctx->ring->flags = ctx->flags;
+    spin_lock_init(&ctx->lock, "ring");
+
+    page = get_page(RING_USER_ADDR, 1, process->page_dir);
+    map_page(page, 0, 1, ctx->phys);
+
+    process->ring = ctx;
+
+    spin_unlock_irqrestore(&ring_setup_lock, irq_state);
+
+    if ((ctx->flags & RING_SQPOLL) &&
+        !create_thread(process, (entry_t)ring_poll, ctx, process->priority, 0, 0)) {
+        /* nobody polls, the process has to enter the kernel */
+        ctx->flags &= ~RING_SQPOLL;
+        ctx->ring->flags = ctx->flags;
+    }
+
+    kprintf(INFO, "[ring] Process %d mapped its ring at %x%s\n", process->id,
+            RING_USER_ADDR, (ctx->flags & RING_SQPOLL) ? ", polled" : "");
+
+    return (ring_t *)RING_USER_ADDR;
+}
+
+/* returns the number of calls run, the poller runs them if there is one */
+int ring_enter(void)
+{
+    process_t *process = get_current_thread()->process;
+    ring_ctx_t *ctx;
+
+    if (!process || !process->ring) {
+        return -1;
+    }
+    ctx = process->ring;
+
+    if (ctx->flags & RING_SQPOLL) {
+        if (ctx->poller) {
+            wake_thread(ctx->poller);
+        }
+        return 0;
+    }
+    return ring_process(ctx);
+}
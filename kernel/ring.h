@@ -0,0 +1,139 @@
+#ifndef __KERNEL_RING_H__
+#define __KERNEL_RING_H__
+
+#include <types.h>
+#include <system.h>
+#include <spinlock.h>
+#include <syscall.h>
+
+/* A page shared between a process and the kernel. Threads queue system
+ * calls in the submission ring and trap once with ring_enter for the
+ * whole batch, or not at all when the process asked for a kernel thread
+ * polling the ring. Results are posted to the completion ring in the
+ * order the calls were submitted. Indices only ever grow, an entry is at
+ * index & RING_MASK. */
+
+#define RING_USER_ADDR      0xbfff0000  /* where the page is in every process */
+#define RING_ENTRIES        64          /* must be a power of 2 */
+#define RING_MASK           (RING_ENTRIES - 1)
+
+#define RING_SQPOLL         (1 << 0)    /* setup flag, a kernel thread polls */
+#define RING_NEED_WAKEUP    (1 << 1)    /* the poller sleeps, enter the kernel */
+
+#define RING_POLL_IDLE      10          /* ms without work before the poller sleeps */
+
+typedef struct
+{
+    uint32_t num;           /* system call number */
+    uint32_t args[5];
+    uint32_t user_data;     /* handed back in the completion */
+    uint32_t pad;
+} ring_sqe_t;
+
+typedef struct
+{
+    uint32_t user_data;
+    int32_t  res;
+} ring_cqe_t;
+
+typedef struct ring
+{
+    volatile uint32_t sq_head;  /* written by the kernel */
+    volatile uint32_t sq_tail;  /* written by the process */
+    volatile uint32_t cq_head;  /* written by the process */
+    volatile uint32_t cq_tail;  /* written by the kernel */
+    volatile uint32_t flags;
+    volatile uint32_t lock;     /* serializes the process' threads */
+    uint32_t          reserved[10];
+    ring_sqe_t        sq[RING_ENTRIES];
+    ring_cqe_t        cq[RING_ENTRIES];
+} ring_t;
+
+/* kernel side, the shared page may be scribbled over at any time */
+typedef struct ring_ctx
+{
+    ring_t        *ring;    /* kernel address of the page */
+    uintptr_t     phys;
+    uint32_t      flags;
+    uint32_t      sq_head;
+    uint32_t      cq_tail;
+    spinlock_t    lock;     /* held while the submissions are run */
+    struct thread *poller;
+} ring_ctx_t;
+
+ring_t *ring_setup(uint32_t flags);
+int ring_enter(void);
+
+DECL_SYSCALL1(ring_setup, uint32_t)
+DECL_SYSCALL0(ring_enter)
+
+/* Helpers for the process, a queued call has to be submitted with
+ * ring_submit. They may be used by several threads at once. */
+
+inline static void ring_barrier(void)
+{
+    asm volatile ("" ::: "memory");
+}
+
+inline static void ring_lock(ring_t *ring)
+{
+    while (__sync_lock_test_and_set(&ring->lock, 1)) {
+        while (ring->lock) {
+            asm volatile ("pause");
+        }
+    }
+}
+
+inline static void ring_unlock(ring_t *ring)
+{
+    __sync_lock_release(&ring->lock);
+}
+
+/* returns 0 when the ring is full */
+inline static int ring_queue(ring_t *ring, uint32_t num, uint32_t p1, uint32_t p2, uint32_t p3, uint32_t user_data)
+{
+    ring_sqe_t *sqe;
+
+    ring_lock(ring);
+    if (ring->sq_tail - ring->sq_head >= RING_ENTRIES) {
+        ring_unlock(ring);
+        return 0;
+    }
+    sqe = &ring->sq[ring->sq_tail & RING_MASK];
+    sqe->num = num;
+    sqe->args[0] = p1;
+    sqe->args[1] = p2;
+    sqe->args[2] = p3;
+    sqe->args[3] = sqe->args[4] = 0;
+    sqe->user_data = user_data;
+    ring_barrier();
+    ++ring->sq_tail;
+    ring_unlock(ring);
+    return 1;
+}
+
+/* traps only if nobody polls the ring */
+inline static void ring_submit(ring_t *ring)
+{
+    __sync_synchronize();   /* the poller may go to sleep meanwhile */
+    if (!(ring->flags & RING_SQPOLL) || (ring->flags & RING_NEED_WAKEUP)) {
+        syscall_ring_enter();
+    }
+}
+
+/* returns 0 when there is no completion */
+inline static int ring_reap(ring_t *ring, ring_cqe_t *cqe)
+{
+    ring_lock(ring);
+    if (ring->cq_head == ring->cq_tail) {
+        ring_unlock(ring);
+        return 0;
+    }
+    *cqe = ring->cq[ring->cq_head & RING_MASK];
+    ring_barrier();
+    ++ring->cq_head;
+    ring_unlock(ring);
+    return 1;
+}
+
+#endif
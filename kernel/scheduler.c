@@ -1,16 +1,295 @@
 #include <system.h>
+#include <spinlock.h>
 #include <thread.h>
 #include <paging.h>
 #include <kheap.h>
 #include <logging.h>
 #include <string.h>
 #include <scheduler.h>
+#include <timer.h>
+#include <fpu.h>
+#include <smp.h>
+#include <vdso.h>
+#include <tracepoint.h>
+#include <vsprintf.h>
+
+DEFINE_TRACEPOINT(sched, switch);
+DEFINE_TRACEPOINT(sched, cr3);
+DEFINE_TRACEPOINT(sched, wake);
+
+/* Every CPU has its own run queue and only looks at the others when it
+ * runs out of work, it then steals a thread from the busiest one. A
+ * thread stays on its CPU when it blocks and is woken there. */
 
 int scheduling = 0;
-thread_t *current_thread = 0;
-thread_t *kernel_thread = 0;
+static thread_t *all_threads = 0;   /* every thread known to the scheduler */
+static spinlock_t threads_lock = SPINLOCK_INIT("threads");
+
+/* ticks a thread may run before being preempted, grows with its priority */
+inline static uint32_t thread_timeslice(const thread_t *thread)
+{
+    return min(SCHED_SLICE_BASE + thread->priority * SCHED_SLICE_STEP, SCHED_SLICE_MAX);
+}
+
+inline static uint32_t latency_bucket(uint64_t cycles)
+{
+    uint32_t bucket = 0;
+
+    cycles >>= 10;
+    while (cycles && bucket < SCHED_LAT_BUCKETS - 1) {
+        cycles >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+/* A CPU only needs its tick when there is someone to preempt there,
+ * called on the CPU owning rq with its lock held. */
+static void update_tick(runqueue_t *rq)
+{
+    if (rq->nr_ready > 1) {
+        timer_nohz_exit();
+    } else {
+        timer_nohz_enter();
+    }
+}
+
+static void register_thread(thread_t *thread)
+{
+    spin_lock(&threads_lock);
+    thread->all_prev = 0;
+    thread->all_next = all_threads;
+    if (all_threads) {
+        all_threads->all_prev = thread;
+    }
+    all_threads = thread;
+    spin_unlock(&threads_lock);
+}
+
+static void enqueue_thread(runqueue_t *rq, thread_t *thread, int front)
+{
+    if (!rq->head) {
+        thread->next = thread->prev = thread;
+        rq->head = thread;
+    } else {
+        thread->next = rq->head;
+        thread->prev = rq->head->prev;
+        rq->head->prev->next = thread;
+        rq->head->prev = thread;
+        if (front) {
+            rq->head = thread;
+        }
+    }
+    ++rq->nr_queued;
+}
+
+static void dequeue_thread(runqueue_t *rq, thread_t *thread)
+{
+    if (thread->next == thread) {
+        rq->head = 0;
+    } else {
+        thread->prev->next = thread->next;
+        thread->next->prev = thread->prev;
+        if (rq->head == thread) {
+            rq->head = thread->next;
+        }
+    }
+    thread->next = thread->prev = 0;
+    --rq->nr_queued;
+}
+
+/* wake an idle CPU so it comes stealing from a busy one */
+static void kick_idle_cpu(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < num_cpus; ++i) {
+        if (cpus[i].rq.current == cpus[i].rq.idle && &cpus[i] != this_cpu()) {
+            smp_send_resched(&cpus[i]);
+            return;
+        }
+    }
+}
+
+/* Queue a ready thread on cpu, its lock held. A thread with a higher
+ * priority than the running one goes first and runs as soon as that CPU
+ * leaves the interrupt or syscall. */
+static void queue_ready_thread(cpu_t *cpu, thread_t *thread)
+{
+    runqueue_t *rq = &cpu->rq;
+    int preempt = rq->current == rq->idle || thread->priority > rq->current->priority;
+
+    thread->cpu = cpu;
+    enqueue_thread(rq, thread, preempt);
+    ++rq->nr_ready;
+
+    if (preempt) {
+        rq->need_resched = 1;
+    }
+    if (cpu == this_cpu()) {
+        update_tick(rq);
+    } else if (preempt || rq->nr_ready > 1) {
+        /* it may have to preempt or restart its tick */
+        smp_send_resched(cpu);
+    }
+    if (!preempt && num_cpus > 1) {
+        kick_idle_cpu();
+    }
+}
+
+/* Take a ready thread from the busiest other CPU. The victim's lock is
+ * only tried, two CPUs stealing from each other would deadlock. Threads
+ * whose FPU state still lives in their CPU's registers can't move. */
+static thread_t *steal_thread(cpu_t *cpu)
+{
+    cpu_t *victim = 0;
+    thread_t *thread;
+    uint32_t i;
 
-extern page_dir_t *current_directory;
+    for (i = 0; i < num_cpus; ++i) {
+        if (&cpus[i] != cpu && cpus[i].rq.nr_queued &&
+            (!victim || cpus[i].rq.nr_queued > victim->rq.nr_queued)) {
+            victim = &cpus[i];
+        }
+    }
+    if (!victim || !spin_trylock(&victim->rq.lock)) {
+        return 0;
+    }
+
+    /* the tail waited the least, it has the coldest cache over there */
+    thread = victim->rq.head ? victim->rq.head->prev : 0;
+    for (i = 0; i < victim->rq.nr_queued; ++i, thread = thread->prev) {
+        if (victim->fpu_owner != thread) {
+            dequeue_thread(&victim->rq, thread);
+            --victim->rq.nr_ready;
+            thread->cpu = cpu;
+            ++cpu->rq.nr_ready;
+            spin_unlock(&victim->rq.lock);
+            return thread;
+        }
+    }
+
+    spin_unlock(&victim->rq.lock);
+    return 0;
+}
+
+/* Pick the next thread and switch to it. Must be called with IRQs disabled
+ * and this CPU's run queue locked, the lock is released once we left the
+ * calling thread and this returns when it is scheduled again. preempt
+ * tells if the current thread is leaving against its will. */
+static void schedule(int preempt)
+{
+    cpu_t *cpu = this_cpu();
+    runqueue_t *rq = &cpu->rq;
+    thread_t *prev = rq->current, *next;
+    uint64_t now = get_cycles_count();
+
+    if (rq->last_switch == 0) {
+        rq->last_switch = now;
+    }
+    rq->need_resched = 0;
+
+    if (prev->timeslice == 0) {
+        prev->timeslice = thread_timeslice(prev);
+    }
+
+    /* a preempted or yielding thread goes to the back of the queue */
+    if (prev->state == TASK_RUNNING) {
+        prev->state = TASK_READY;
+        if (prev != rq->idle) {
+            enqueue_thread(rq, prev, 0);
+        }
+    }
+
+    next = rq->head;
+    if (next) {
+        dequeue_thread(rq, next);
+    } else if (num_cpus > 1) {
+        next = steal_thread(cpu);
+    }
+
+    if (!next) {
+        /* nothing else can run */
+        next = rq->idle;
+        if (!next) {
+            /* a thread that wanted to block wakes up right away */
+            if (prev->state == TASK_SLEEP) {
+                ++rq->nr_ready;
+            }
+            prev->state = TASK_RUNNING;
+            spin_unlock(&rq->lock);
+            return;
+        }
+    }
+
+    if (next == prev) {
+        /* keep executing the same stuff */
+        prev->state = TASK_RUNNING;
+        spin_unlock(&rq->lock);
+        return;
+    }
+
+    /* the stack of a finished thread can only be freed once we left it */
+    if (prev->state == TASK_FINISHED) {
+        rq->dead = prev;
+        --rq->nr_ready;
+    } else {
+        prev->runtime += now - rq->last_switch;
+    }
+    prev->stats.stamp = now;
+    if (preempt && prev->state == TASK_READY) {
+        ++prev->stats.nivcsw;
+    } else {
+        ++prev->stats.nvcsw;
+    }
+
+    /* time since the thread became ready */
+    uint64_t wait = now - next->stats.stamp;
+    next->stats.wait_time += wait;
+    ++next->stats.latency[latency_bucket(wait)];
+    ++rq->nr_switches;
+
+    next->state = TASK_RUNNING;
+    if (next->timeslice == 0) {
+        next->timeslice = thread_timeslice(next);
+    }
+    tracepoint(sched, switch, "%u -> %u%s", prev->id, next->id, preempt ? " (preempted)" : "");
+    rq->current = next;
+    vdso_set_current(next);
+    if (next->kstack) {
+        set_kernel_stack(kstack_top(next->kstack));
+    }
+    if (prev->page_dir != next->page_dir) {
+        tracepoint(sched, cr3, "page dir %x -> %x", prev->page_dir, next->page_dir);
+        switch_page_directory(next->page_dir);
+        ++rq->nr_cr3_switches;
+    }
+
+    update_tick(rq);
+    fpu_switch(next);
+
+    rq->last_switch = get_cycles_count();
+
+    switch_context(&prev->esp, next->esp);
+
+    /* we are back in prev */
+    schedule_tail();
+}
+
+/* first thing run by a thread once switched to, on the CPU it landed on */
+void schedule_tail(void)
+{
+    runqueue_t *rq = &this_cpu()->rq;
+    thread_t *dead = rq->dead;
+
+    rq->dead = 0;
+    spin_unlock(&rq->lock);
+
+    if (dead) {
+        unschedule_thread(dead);
+        destroy_thread(dead);
+    }
+}
 
 void schedule_thread(thread_t *thread)
 {
@@ -18,136 +297,340 @@ void schedule_thread(thread_t *thread)
         return;
     }
     irq_state_t irq_state = irq_save();
+    cpu_t *cpu = this_cpu();
+
+    register_thread(thread);
 
+    spin_lock(&cpu->rq.lock);
     thread->state = TASK_READY;
-    thread->next = thread->prev = 0;
+    thread->stats.stamp = get_cycles_count();
+    queue_ready_thread(cpu, thread);
+    spin_unlock_irqrestore(&cpu->rq.lock, irq_state);
+}
 
-    if (!kernel_thread) {
-        kernel_thread = thread;
-        current_thread = thread;
-        current_thread->next = current_thread->prev = thread;
-    } else {
-        thread->prev = current_thread->prev;
-        thread->next = current_thread;
-        current_thread->prev->next = thread;
-        current_thread->prev = thread;
-    }
+/* the context we are running on becomes the current thread of this CPU */
+void schedule_current(thread_t *thread)
+{
+    irq_state_t irq_state = irq_save();
+    cpu_t *cpu = this_cpu();
 
-    irq_restore(irq_state);
+    register_thread(thread);
+
+    spin_lock(&cpu->rq.lock);
+    thread->cpu = cpu;
+    thread->state = TASK_RUNNING;
+    thread->stats.stamp = get_cycles_count();
+    cpu->rq.current = thread;
+    if (thread != cpu->rq.idle) {
+        ++cpu->rq.nr_ready;
+    }
+    spin_unlock_irqrestore(&cpu->rq.lock, irq_state);
 }
 
 void unschedule_thread(struct thread *thread)
 {
-    if (!thread || thread == kernel_thread) {
+    if (!thread) {
         return;
     }
-    //DBPRINT(" unsched  ");
-    irq_state_t irq_state = irq_save();
+    irq_state_t irq_state = spin_lock_irqsave(&threads_lock);
 
-    if (thread->prev) {
-        thread->prev->next = thread->next;
+    if (thread->all_prev) {
+        thread->all_prev->all_next = thread->all_next;
+    } else if (all_threads == thread) {
+        all_threads = thread->all_next;
     }
-    if (thread->next) {
-        thread->next->prev = thread->prev;
+    if (thread->all_next) {
+        thread->all_next->all_prev = thread->all_prev;
     }
+    thread->all_next = thread->all_prev = 0;
 
-    irq_restore(irq_state);
+    spin_unlock_irqrestore(&threads_lock, irq_state);
 }
 
+thread_t *get_current_thread(void)
+{
+    return this_cpu_current();
+}
 
-void switch_next(void)
+void thread_yield(void)
 {
-    irq_enable();
-    interrupt(IRQ(0));
+    irq_state_t irq_state = irq_save();
+    runqueue_t *rq = &this_cpu()->rq;
+
+    spin_lock(&rq->lock);
+    schedule(0);
+    irq_restore(irq_state);
 }
 
-inline static thread_t *next_ready_thread(void)
+void block_thread(void)
 {
-    if (!current_thread) {
-        return 0;
-    }
-    thread_t *thread = current_thread->next;
-    while (thread && thread->state == TASK_SLEEP) {
-        thread = thread->next;
+    assert(!in_interrupt());
+    irq_state_t irq_state = irq_save();
+    runqueue_t *rq = &this_cpu()->rq;
+
+    spin_lock(&rq->lock);
+    /* woken by another CPU before we got here */
+    if (rq->current->wake_pending) {
+        rq->current->wake_pending = 0;
+        spin_unlock_irqrestore(&rq->lock, irq_state);
+        return;
     }
-    return thread;
+    rq->current->state = TASK_SLEEP;
+    --rq->nr_ready;
+    schedule(0);
+    irq_restore(irq_state);
 }
 
-uintptr_t schedule_tick(registers_t *regs)
+void wake_thread(thread_t *thread)
 {
-    //DBPRINT("switch ");
+    if (!thread || !thread->cpu) {
+        return;
+    }
+    tracepoint(sched, wake, "%u on cpu %u", thread->id, thread->cpu->id);
     irq_state_t irq_state = irq_save();
+    cpu_t *cpu = thread->cpu;
 
-    static uint64_t old_cycles_count = 0;
-    uint64_t new_cycles_count;
-    uintptr_t esp, old_esp = (uintptr_t)regs;
-
-    if (old_cycles_count == 0) {
-        old_cycles_count = get_cycles_count();
+    spin_lock(&cpu->rq.lock);
+    if (thread->state == TASK_SLEEP) {
+        uint64_t now = get_cycles_count();
+        thread->stats.sleep_time += now - thread->stats.stamp;
+        thread->stats.stamp = now;
+        thread->state = TASK_READY;
+        queue_ready_thread(cpu, thread);
+    } else {
+        thread->wake_pending = 1;
     }
-    new_cycles_count = get_cycles_count();
+    spin_unlock_irqrestore(&cpu->rq.lock, irq_state);
+}
 
-    thread_t *next = next_ready_thread();
+/* Puts the current thread on the queue, it then checks once more that it
+ * has to wait and calls block_thread. A wake-up in between makes
+ * block_thread return at once. */
+void wait_queue_add(wait_queue_t *wq)
+{
+    thread_t *current = get_current_thread();
+    irq_state_t irq_state = spin_lock_irqsave(&wq->lock);
 
-    /*uintptr_t esp_;
-    asm volatile("mov %%esp, %0" : "=r" (esp_));
-    DBPRINT("current esp = %x\n", esp_);
-    */
+    if (current->wait_on != wq) {
+        current->wait_on = wq;
+        current->wait_next = wq->head;
+        wq->head = current;
+    }
 
-    //DBPRINT("- cur:%x next:%x ", current_thread, next);
+    spin_unlock_irqrestore(&wq->lock, irq_state);
+}
 
-    if (next && next != current_thread) {
+/* takes the current thread off the queue if nobody woke it yet */
+void wait_queue_remove(wait_queue_t *wq)
+{
+    thread_t *current = get_current_thread();
+    thread_t **link;
+    irq_state_t irq_state = spin_lock_irqsave(&wq->lock);
 
-        /* register current esp and terminate task if needed */
-        if (current_thread->state == TASK_FINISHED) {
-            unschedule_thread(current_thread);
-            destroy_thread(current_thread);
-        } else {
-            current_thread->esp = old_esp;
-            current_thread->state = TASK_READY;
-            current_thread->runtime += new_cycles_count - old_cycles_count;
+    if (current->wait_on == wq) {
+        for (link = &wq->head; *link; link = &(*link)->wait_next) {
+            if (*link == current) {
+                *link = current->wait_next;
+                break;
+            }
         }
+        current->wait_on = 0;
+    }
 
-        /* switch to next task */
-        esp = next->esp;
-        set_kernel_stack(esp);
-        next->state = TASK_RUNNING;
-        current_thread = next;
-        if (current_directory != current_thread->page_dir) {
-            DBPRINT("page dir: %x -> %x nthreads:%d\n", 
-                    current_directory, current_thread->page_dir, get_num_threads());
-            switch_page_directory(current_thread->page_dir);
-        }
+    spin_unlock_irqrestore(&wq->lock, irq_state);
+}
 
-    } else {
-        /* keep executing the same stuff */
-        esp = old_esp;
+void wake_up_all(wait_queue_t *wq)
+{
+    thread_t *thread, *next;
+    irq_state_t irq_state = spin_lock_irqsave(&wq->lock);
+
+    thread = wq->head;
+    wq->head = 0;
+    for (; thread; thread = next) {
+        next = thread->wait_next;
+        thread->wait_on = 0;
+        wake_thread(thread);
     }
-    //DBPRINT("- esp: %x->%x\n", old_esp, esp);
 
-    old_cycles_count = get_cycles_count();
+    spin_unlock_irqrestore(&wq->lock, irq_state);
+}
 
-    irq_restore(irq_state);
+uintptr_t schedule_tick(registers_t *regs)
+{
+    /* called from the timer interrupt with interrupts disabled, only leave
+     * the thread once its time slice is used up or someone more important
+     * woke. An idle CPU looks for work to steal. */
+    runqueue_t *rq = &this_cpu()->rq;
+    thread_t *current = rq->current;
+
+    if (current->timeslice > 0) {
+        --current->timeslice;
+    }
+    if (current->timeslice == 0 || rq->need_resched || current == rq->idle) {
+        spin_lock(&rq->lock);
+        schedule(1);
+    }
+
+    return (uintptr_t)regs;
+}
 
-    return esp;
+/* on the way out of any other interrupt or a system call, a thread
+ * woken meanwhile may preempt the interrupted one */
+void schedule_irq_exit(void)
+{
+    runqueue_t *rq = &this_cpu()->rq;
+
+    if (rq->need_resched) {
+        spin_lock(&rq->lock);
+        schedule(1);
+    }
+}
+
+/* another CPU queued a thread here */
+void schedule_ipi(void)
+{
+    runqueue_t *rq = &this_cpu()->rq;
+
+    spin_lock(&rq->lock);
+    update_tick(rq);
+    if (rq->need_resched) {
+        schedule(1);
+    } else {
+        spin_unlock(&rq->lock);
+    }
+}
+
+static void idle(void)
+{
+    for (;;) {
+        halt();
+    }
 }
 
 void scheduling_init(void)
 {
     irq_state_t irq_state = irq_save();
-    if (!current_thread) {
+    runqueue_t *rq = &this_cpu()->rq;
+
+    spin_lock_register(&threads_lock);
+    spin_lock_init(&rq->lock, "runqueue");
+    spin_lock_register(&rq->lock);
+
+    if (!rq->current) {
         create_kernel_thread();
     }
+    if (!rq->idle) {
+        rq->idle = create_idle_thread(idle);
+        rq->idle->cpu = this_cpu();
+        register_thread(rq->idle);
+    }
     scheduling = 1;
     irq_restore(irq_state);
 }
 
+/* the boot context of an application processor becomes its idle thread */
+void scheduling_init_ap(void)
+{
+    cpu_t *cpu = this_cpu();
+
+    spin_lock_init(&cpu->rq.lock, "runqueue");
+    spin_lock_register(&cpu->rq.lock);
+
+    cpu->rq.idle = create_cpu_thread(cpu->stack);
+    schedule_current(cpu->rq.idle);
+}
+
 void scheduling_finish(void)
 {
     scheduling = 0;
 }
 
+static thread_t *find_thread(uint32_t id)
+{
+    thread_t *thread;
+
+    for (thread = all_threads; thread; thread = thread->all_next) {
+        if (thread->id == id) {
+            return thread;
+        }
+    }
+    return 0;
+}
+
+int sched_get_stats(uint32_t id, sched_stats_t *stats)
+{
+    uint32_t i;
+    irq_state_t irq_state = spin_lock_irqsave(&threads_lock);
+
+    thread_t *thread = find_thread(id);
+    if (!thread) {
+        spin_unlock_irqrestore(&threads_lock, irq_state);
+        return -1;
+    }
+
+    stats->id = thread->id;
+    stats->state = thread->state;
+    stats->priority = thread->priority;
+    stats->runtime = thread->runtime;
+    stats->nvcsw = thread->stats.nvcsw;
+    stats->nivcsw = thread->stats.nivcsw;
+    stats->wait_time = thread->stats.wait_time;
+    stats->sleep_time = thread->stats.sleep_time;
+    memcpy(stats->latency, thread->stats.latency, sizeof(stats->latency));
+    stats->switches = 0;
+    stats->cr3_switches = 0;
+    for (i = 0; i < num_cpus; ++i) {
+        stats->switches += cpus[i].rq.nr_switches;
+        stats->cr3_switches += cpus[i].rq.nr_cr3_switches;
+    }
+
+    spin_unlock_irqrestore(&threads_lock, irq_state);
+    return 0;
+}
+
+static void dump_thread_stats(thread_t *thread)
+{
+    char hist[SCHED_LAT_BUCKETS * 11 + 1];
+    size_t len = 0;
+    uint32_t i;
+
+    for (i = 0; i < SCHED_LAT_BUCKETS; ++i) {
+        len += snprintf(hist + len, sizeof(hist) - len, " %u", thread->stats.latency[i]);
+    }
+
+    /* cycle counts are shown in units of 1024 to stay in 32 bits */
+    kprintf(INFO, "%4u %3u %2d %3u %10u %6u %6u %10u %10u |%s\n",
+            thread->id, thread->cpu ? thread->cpu->id : 0,
+            thread->state, thread->priority,
+            (uint32_t)(thread->runtime >> 10),
+            thread->stats.nvcsw, thread->stats.nivcsw,
+            (uint32_t)(thread->stats.wait_time >> 10),
+            (uint32_t)(thread->stats.sleep_time >> 10), hist);
+}
+
+void sched_dump_stats(void)
+{
+    thread_t *thread;
+    uint32_t i;
+    irq_state_t irq_state = irq_save();
+
+    for (i = 0; i < num_cpus; ++i) {
+        kprintf(INFO, "[sched] cpu %u: %u switches, %u cr3 reloads, %u ready, %u irqs, %u syscalls\n",
+                i, cpus[i].rq.nr_switches, cpus[i].rq.nr_cr3_switches,
+                cpus[i].rq.nr_ready, cpus[i].nr_irqs, cpus[i].nr_syscalls);
+    }
+    kprintf(INFO, "  id cpu st pri    run(Kc)  nvcsw nivcsw   wait(Kc)  sleep(Kc) |\n");
+
+    spin_lock(&threads_lock);
+    for (thread = all_threads; thread; thread = thread->all_next) {
+        dump_thread_stats(thread);
+    }
+    spin_unlock_irqrestore(&threads_lock, irq_state);
+}
+
 uint32_t getpid(void)
 {
-    return current_thread != 0 ? current_thread->id : 0;
+    thread_t *thread = get_current_thread();
+    return thread != 0 ? thread->id : 0;
 }
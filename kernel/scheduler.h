@@ -1,18 +1,82 @@
 #ifndef __KERNEL_SCHEDULER_H__
 #define __KERNEL_SCHEDULER_H__
 
+#include <types.h>
+#include <spinlock.h>
+
+#define SCHED_SLICE_BASE    10  /* ticks given to a priority 0 thread */
+#define SCHED_SLICE_STEP    5   /* extra ticks per priority level */
+#define SCHED_SLICE_MAX     100
+
+#define SCHED_LAT_BUCKETS   16  /* bucket i counts latencies below 2^(i + 10) cycles */
+
 struct thread;
 struct registers;
 
+/* one per CPU, only touched with its lock held and IRQs disabled */
+typedef struct runqueue
+{
+    spinlock_t      lock;
+    struct thread   *current;
+    struct thread   *idle;      /* runs when nothing else can, never queued */
+    struct thread   *dead;      /* freed once we left its stack */
+    struct thread   *head;      /* ready threads, circular list */
+    uint32_t        nr_queued;
+    uint32_t        nr_ready;   /* queued or running threads, idle excluded */
+    int             need_resched;
+    uint32_t        nr_switches;
+    uint32_t        nr_cr3_switches;
+    uint64_t        last_switch; /* cycles at the last context switch */
+} runqueue_t;
+
+/* threads sleeping until something happens, all of them are woken and
+ * taken off the queue at once */
+typedef struct wait_queue
+{
+    spinlock_t    lock;
+    struct thread *head;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT(n)  { SPINLOCK_INIT(n), 0 }
+
+typedef struct
+{
+    uint32_t id;
+    int      state;
+    uint32_t priority;
+    uint64_t runtime;
+    uint32_t nvcsw;
+    uint32_t nivcsw;
+    uint64_t wait_time;
+    uint64_t sleep_time;
+    uint32_t latency[SCHED_LAT_BUCKETS];
+    uint32_t switches;      /* context switches, all threads */
+    uint32_t cr3_switches;  /* page directory reloads, all threads */
+} sched_stats_t;
+
 void schedule_thread(struct thread *thread);
+void schedule_current(struct thread *thread);
 void unschedule_thread(struct thread *thread);
+struct thread *get_current_thread(void);
 
 uintptr_t schedule_tick(struct registers *regs);
-void switch_next(void);
+void schedule_irq_exit(void);
+void schedule_ipi(void);
+void schedule_tail(void);
+void thread_yield(void);
+void block_thread(void);
+void wake_thread(struct thread *thread);
+void wait_queue_add(wait_queue_t *wq);
+void wait_queue_remove(wait_queue_t *wq);
+void wake_up_all(wait_queue_t *wq);
 
 void scheduling_init(void);
+void scheduling_init_ap(void);
 void scheduling_finish(void);
 
+int sched_get_stats(uint32_t id, sched_stats_t *stats);
+void sched_dump_stats(void);
+
 uint32_t getpid(void);
 
 #endif
@@ -2,6 +2,9 @@
 #include <serial.h>
 #include <types.h>
 #include <vsprintf.h>
+#include <spinlock.h>
+#include <string.h>
+#include <utils.h>
 
 #define SERIAL_DATA(base)               (base)
 #define SERIAL_DLL(base)                (base + 0) /* divisor latch low byte */
@@ -15,11 +18,53 @@
 #define SERIAL_MODEM_STATUS(base)       (base + 6) /* modem status register */
 #define SERIAL_SCRATCH(base)            (base + 7) /* scratch register */
 
+#define SERIAL_IRQ          4
+#define SERIAL_FIFO_SIZE    16
+#define SERIAL_TX_SIZE      8192    /* holds a log line with its escapes */
+#define SERIAL_RX_SIZE      256
+#define SERIAL_BAUD_BASE    115200  /* the divisor divides it */
+#define SERIAL_BAUD         38400
+#define TERM_ESC_SIZE       16
+
+#define LSR_DATA_READY      0x01
+#define LSR_THR_EMPTY       0x20
+#define LSR_TX_IDLE         0x40
+#define IER_RX_AVAIL        0x01
+#define IER_THR_EMPTY       0x02
+#define IIR_NO_INT          0x01
+#define IIR_ID              0x0e
+#define IIR_MODEM_STATUS    0x00
+#define IIR_RX_AVAIL        0x04
+#define IIR_LINE_STATUS     0x06
+#define IIR_RX_TIMEOUT      0x0c
+
 static uint16_t com;
 static device_t com_device;
 
+/* Once the interrupt is on, queued bytes are written 16 at a time each
+ * time the FIFO runs empty. When the ring is empty the refill callback
+ * is asked for more, it is called with tx_lock held. */
+static char tx_ring[SERIAL_TX_SIZE];
+static uint32_t tx_head = 0;
+static uint32_t tx_tail = 0;
+static serial_refill_t tx_refill = 0;
+static spinlock_t tx_lock = SPINLOCK_INIT("serial tx");
+
+/* The bytes received are kept until read, newer ones are dropped if
+ * nobody reads them. The callback is told from the interrupt. */
+static uint8_t rx_ring[SERIAL_RX_SIZE];
+static uint32_t rx_head = 0;
+static uint32_t rx_tail = 0;
+static void (*rx_notify)(void) = 0;
+static spinlock_t rx_lock = SPINLOCK_INIT("serial rx");
+
+/* the terminal sequence for each VGA attribute, made once */
+static char term_esc[256][TERM_ESC_SIZE];
+static uint8_t term_esc_len[256];
+
 static int is_transmit_empty(void);
 static void write_char(char c);
+static size_t read(uint8_t *data, size_t len);
 
 static const char *term_fg[] =
 {
@@ -61,33 +106,36 @@ static const char *term_bg[] =
     "47",  /* white */
 };
 
-#if 0
-static int serial_received(void);
-static char read_char(void);
-#endif
-
 void kernel_voffset(void);
 
+static void set_divisor(uint16_t divisor)
+{
+    outb(SERIAL_LINE_CTRL(com), 0x80);      /* enable DLAB */
+    outb(SERIAL_DLL(com), divisor);         /* send divisor low byte */
+    outb(SERIAL_DLH(com), divisor >> 8);    /* send divisor high byte */
+    outb(SERIAL_LINE_CTRL(com), 0x03);      /* 8 bits, no parity, one stop bit */
+}
+
 device_t *serial_init(void)
 {
     const char *init_message = "\n\033[4;35;40mSerial output from kernel\033[0;37;40m\n";
-
-    uint16_t divisor = 3; /* 115200 / 3 = 38400 Hz */
+    unsigned i;
 
     /* get the base address of COM1 port in the BDA */
     com = *((uint16_t *)(0x0400 + (unsigned)&kernel_voffset));
 
+    for (i = 0; i < 256; ++i) {
+        term_esc_len[i] = snprintf(term_esc[i], TERM_ESC_SIZE, term_fg[i % 16], term_bg[i / 16]);
+    }
+
     outb(SERIAL_INT_ENABLE(com), 0x00);     /* disable interrupts */
-    outb(SERIAL_LINE_CTRL(com), 0x80);      /* enable DLAB */
-    outb(SERIAL_DLL(com), divisor);         /* send divisor low byte */
-    outb(SERIAL_DLH(com), divisor >> 8);    /* send divisor high byte */
+    set_divisor(SERIAL_BAUD_BASE / SERIAL_BAUD);
 
     /* Bit:     | 7    | 6     | 5 4 3  | 2    | 1 0     |
      * Content: | DLAB | break | parity | stop | length  |
      * Value:   | 0    | 0     | 0 0 0  | 0    | 1 1     | = 0x03
      * Means: length of 8 bits, no parity bit, one stop bit and break control disabled.
      */
-    outb(SERIAL_LINE_CTRL(com), 0x03);
 
     /* Bit:     | 7 6         | 5        | 4   | 3        | 2              | 1               | 0            |
      * Content: | trig. level | 64B FIFO | res | DMA mode | clear tr. FIFO | clear rec. FIFO | enable FIFOs |
@@ -106,9 +154,7 @@ device_t *serial_init(void)
      */
     outb(SERIAL_MODEM_CTRL(com), 0x0b);
 
-    //outb(SERIAL_INT_ENABLE(com), 0x01); /* enable interrupts on receive */
-
-    com_device.read = 0;
+    com_device.read = read;
     com_device.write = write;
 
     while (*init_message) {
@@ -127,51 +173,242 @@ void serial_terminate(void)
     }
 }
 
+/* the baud rate is 115200 divided by an integer, it is rounded up to
+ * the next one possible */
+void serial_set_baud(uint32_t baud)
+{
+    uint32_t divisor = baud ? SERIAL_BAUD_BASE / baud : 0;
+
+    if (divisor < 1) {
+        divisor = 1;
+    } else if (divisor > 0xffff) {
+        divisor = 0xffff;
+    }
+
+    /* what is queued goes out at the old rate */
+    serial_flush();
+    irq_state_t irq_state = spin_lock_irqsave(&tx_lock);
+    while (!(inb(SERIAL_LINE_STATUS(com)) & LSR_TX_IDLE)) ;
+    set_divisor(divisor);
+    spin_unlock_irqrestore(&tx_lock, irq_state);
+
+    kprintf(INFO, "[serial] %u baud\n", SERIAL_BAUD_BASE / divisor);
+}
+
+/* serial=<baud> on the kernel command line */
+void serial_setup(const char *cmdline)
+{
+    char baud[12];
+    size_t len;
+
+    for (; cmdline && *cmdline; ++cmdline) {
+        if (strncmp(cmdline, "serial=", 7) == 0) {
+            cmdline += 7;
+            for (len = 0; len < sizeof(baud) - 1 && is_digit(cmdline[len]); ++len) {
+                baud[len] = cmdline[len];
+            }
+            baud[len] = '\0';
+            serial_set_baud(atoi(baud));
+            break;
+        }
+    }
+}
+
+/* written at once, the interrupt doesn't fill the FIFO meanwhile */
 size_t write(uint8_t *data, size_t len)
 {
     size_t i;
-    const char *fmt;
-    char buf[32] = { 0 };
-    unsigned k = 0;
+    const char *esc;
 
+    irq_state_t irq_state = spin_lock_irqsave(&tx_lock);
     for (i = 0; *data && i < len; ++data, ++i) {
         if (*data == '\033') {
             ++data;
             ++i;
-            fmt = term_fg[*data % 16];
-            sprintf(buf, fmt, term_bg[*data / 16]);
-            for (k = 0; buf[k]; ++k) {
-                write_char(buf[k]);
+            for (esc = term_esc[*data]; *esc; ++esc) {
+                write_char(*esc);
             }
         } else {
             write_char(*data);
         }
     }
+    spin_unlock_irqrestore(&tx_lock, irq_state);
     return i;
 }
 
-static int is_transmit_empty(void)
+/* for the refill callback, the escapes are replaced by the terminal's
+ * sequences. Returns 0 if there is no room for all of it. */
+int serial_queue(const uint8_t *data, size_t len)
 {
-    return inb(SERIAL_LINE_STATUS(com)) & 0x20;
+    size_t i, k, needed = 0;
+
+    for (i = 0; i < len && data[i]; ++i) {
+        if (data[i] == '\033' && i + 1 < len) {
+            ++i;
+            needed += term_esc_len[data[i]];
+        } else {
+            ++needed;
+        }
+    }
+    if (needed > SERIAL_TX_SIZE - (tx_head - tx_tail)) {
+        return 0;
+    }
+
+    for (i = 0; i < len && data[i]; ++i) {
+        if (data[i] == '\033' && i + 1 < len) {
+            ++i;
+            for (k = 0; k < term_esc_len[data[i]]; ++k) {
+                tx_ring[tx_head++ % SERIAL_TX_SIZE] = term_esc[data[i]][k];
+            }
+        } else {
+            tx_ring[tx_head++ % SERIAL_TX_SIZE] = data[i];
+        }
+    }
+    return 1;
 }
 
-static void write_char(char c)
+/* returns 0 once there is nothing left to send */
+static int tx_pending(void)
 {
-    while (is_transmit_empty() == 0) ;
-    outb(SERIAL_DATA(com), c);
+    return tx_head != tx_tail || (tx_refill && tx_refill());
 }
 
-#if 0
-static int serial_received(void)
+/* called with tx_lock held, the FIFO takes up to 16 bytes once empty */
+static void tx_fill(void)
 {
-    return inb(SERIAL_LINE_STATUS(com)) & 0x01;
+    uint32_t n;
+
+    if (!is_transmit_empty()) {
+        return;
+    }
+    for (n = 0; n < SERIAL_FIFO_SIZE && tx_pending(); ++n) {
+        outb(SERIAL_DATA(com), tx_ring[tx_tail++ % SERIAL_TX_SIZE]);
+    }
 }
 
-static char read_char(void)
+/* takes what the receive FIFO holds */
+static int rx_drain(void)
 {
-    if (serial_received() == 0)
-        return 0;
-    return inb(SERIAL_DATA(com));
+    int received = 0;
+
+    spin_lock(&rx_lock);
+    while (inb(SERIAL_LINE_STATUS(com)) & LSR_DATA_READY) {
+        uint8_t c = inb(SERIAL_DATA(com));
+        if (rx_head - rx_tail < SERIAL_RX_SIZE) {
+            rx_ring[rx_head++ % SERIAL_RX_SIZE] = c;
+            received = 1;
+        }
+    }
+    spin_unlock(&rx_lock);
+
+    return received;
+}
+
+/* the identification register gives the most urgent cause first, it is
+ * read again until none is left */
+static void serial_irq(registers_t *regs)
+{
+    uint8_t iir;
+    int received = 0;
+
+    (void)regs;
+    while (!((iir = inb(SERIAL_INT_IDENT(com))) & IIR_NO_INT)) {
+        switch (iir & IIR_ID) {
+        case IIR_LINE_STATUS:
+            inb(SERIAL_LINE_STATUS(com));
+            break;
+        case IIR_MODEM_STATUS:
+            inb(SERIAL_MODEM_STATUS(com));
+            break;
+        case IIR_RX_AVAIL:
+        case IIR_RX_TIMEOUT:
+            received |= rx_drain();
+            break;
+        default: /* transmitter empty */
+            spin_lock(&tx_lock);
+            tx_fill();
+            spin_unlock(&tx_lock);
+            break;
+        }
+    }
+
+    if (received && rx_notify) {
+        rx_notify();
+    }
+}
+
+/* returns the number of bytes read, without waiting for any */
+static size_t read(uint8_t *data, size_t len)
+{
+    size_t n;
+
+    irq_state_t irq_state = spin_lock_irqsave(&rx_lock);
+    for (n = 0; n < len && rx_tail != rx_head; ++n) {
+        data[n] = rx_ring[rx_tail++ % SERIAL_RX_SIZE];
+    }
+    spin_unlock_irqrestore(&rx_lock, irq_state);
+
+    return n;
+}
+
+/* notify is called from the interrupt when bytes arrived */
+void serial_set_rx(void (*notify)(void))
+{
+    rx_notify = notify;
 }
-#endif
 
+void serial_set_refill(serial_refill_t refill)
+{
+    irq_state_t irq_state = spin_lock_irqsave(&tx_lock);
+    tx_refill = refill;
+    spin_unlock_irqrestore(&tx_lock, irq_state);
+}
+
+/* from now on the FIFO is filled when the transmitter asks for it and
+ * emptied when bytes are received */
+void serial_start_irq(void)
+{
+    spin_lock_register(&tx_lock);
+    spin_lock_register(&rx_lock);
+    attach_interrupt_handler(IRQ(SERIAL_IRQ), serial_irq);
+    outb(SERIAL_INT_ENABLE(com), IER_THR_EMPTY | IER_RX_AVAIL);
+    enable_irq(SERIAL_IRQ);
+    serial_kick();
+}
+
+/* starts the transmission if the transmitter is idle, the interrupt
+ * carries on with the rest */
+void serial_kick(void)
+{
+    irq_state_t irq_state = spin_lock_irqsave(&tx_lock);
+    tx_fill();
+    spin_unlock_irqrestore(&tx_lock, irq_state);
+}
+
+/* waits until everything went out. The lock is dropped after each
+ * refill so the other CPUs can queue theirs meanwhile. */
+void serial_flush(void)
+{
+    for (;;) {
+        irq_state_t irq_state = spin_lock_irqsave(&tx_lock);
+        if (!tx_pending()) {
+            spin_unlock_irqrestore(&tx_lock, irq_state);
+            return;
+        }
+        while (tx_head != tx_tail) {
+            write_char(tx_ring[tx_tail++ % SERIAL_TX_SIZE]);
+        }
+        spin_unlock_irqrestore(&tx_lock, irq_state);
+    }
+}
+
+static int is_transmit_empty(void)
+{
+    return inb(SERIAL_LINE_STATUS(com)) & LSR_THR_EMPTY;
+}
+
+static void write_char(char c)
+{
+    while (is_transmit_empty() == 0) ;
+    outb(SERIAL_DATA(com), c);
+}
@@ -4,8 +4,20 @@
 #include <driver.h>
 #include <types.h>
 
+/* returns nonzero if it queued more bytes with serial_queue */
+typedef int (*serial_refill_t)(void);
+
 device_t *serial_init(void);
 void serial_terminate(void);
 size_t write(uint8_t *data, size_t len);
 
+int serial_queue(const uint8_t *data, size_t len);
+void serial_set_refill(serial_refill_t refill);
+void serial_start_irq(void);
+void serial_kick(void);
+void serial_flush(void);
+void serial_set_baud(uint32_t baud);
+void serial_setup(const char *cmdline);
+void serial_set_rx(void (*notify)(void));
+
 #endif
@@ -0,0 +1,153 @@
+#include <system.h>
+#include <string.h>
+#include <paging.h>
+#include <kheap.h>
+#include <idt.h>
+#include <gdt.h>
+#include <thread.h>
+#include <fpu.h>
+#include <lapic.h>
+#include <mp.h>
+#include <syscall.h>
+#include <smp.h>
+
+/* The application processors are those listed in the MultiProcessor
+ * Specification tables (see mp.c). Each of them is woken with
+ * INIT-SIPI-SIPI and starts in real mode in smpboot.s. */
+
+#define PHYS_TO_VIRT(addr)  ((uintptr_t)(addr) + (uintptr_t)&kernel_voffset)
+
+extern uint32_t kernel_voffset;
+extern page_dir_t *kernel_directory;
+
+extern uint8_t ap_trampoline[];
+extern uint8_t ap_trampoline_end[];
+extern uint8_t ap_boot_cr3[];
+extern uint8_t ap_boot_stack[];
+extern uint8_t ap_boot_entry[];
+extern uint8_t ap_boot_cpu[];
+
+extern void apic241();
+extern void apic242();
+
+cpu_t cpus[MAX_CPUS];
+uint32_t num_cpus = 1;
+
+static void ap_main(cpu_t *cpu)
+{
+    gdt_init_cpu(cpu);
+    idt_load();
+    syscall_init_ap();
+    lapic_init_ap();
+    fpu_init_ap();
+    paging_init_pat_ap();
+    cpu->nohz = 1;  /* the local timer starts once there is a thread to preempt */
+    scheduling_init_ap();
+
+    cpu->started = 1;
+    kprintf(INFO, "[smp] CPU %u (APIC %u) online\n", cpu->id, cpu->apic_id);
+
+    irq_enable();
+    for (;;) {
+        halt();
+    }
+}
+
+#define TRAMPOLINE_VAR(sym) \
+    (*(uint32_t *)PHYS_TO_VIRT(AP_TRAMPOLINE + ((sym) - ap_trampoline)))
+
+static int smp_boot_ap(cpu_t *cpu, uint32_t apic_id)
+{
+    uint32_t i;
+
+    cpu->id = cpu - cpus;
+    cpu->apic_id = apic_id;
+    cpu->page_dir = kernel_directory;
+    cpu->stack = (uintptr_t)kmalloc(STACK_SIZE);
+    if (!cpu->stack) {
+        return 0;
+    }
+    irq_stack_init(cpu);
+
+    TRAMPOLINE_VAR(ap_boot_cr3) = kernel_directory->entries_phys_addr;
+    TRAMPOLINE_VAR(ap_boot_stack) = stack_top(cpu->stack);
+    TRAMPOLINE_VAR(ap_boot_entry) = (uintptr_t)ap_main;
+    TRAMPOLINE_VAR(ap_boot_cpu) = (uintptr_t)cpu;
+
+    lapic_send_init(apic_id);
+    sleep(10);
+    for (i = 0; i < 2 && !cpu->started; ++i) {
+        lapic_send_startup(apic_id, AP_TRAMPOLINE >> 12);
+        sleep(1);
+    }
+    for (i = 0; i < 100 && !cpu->started; ++i) {
+        sleep(1);
+    }
+
+    if (!cpu->started) {
+        kprintf(WARNING, "[smp] APIC %u did not start\n", apic_id);
+        kfree((void *)cpu->stack);
+        kfree((void *)(cpu->irq_stack - IRQ_STACK_SIZE));
+        cpu->irq_stack = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void smp_init(void)
+{
+    uint32_t i;
+
+    if (!lapic_enabled()) {
+        kprintf(INFO, "[smp] No local APIC, running on a single CPU\n");
+        return;
+    }
+
+    cpus[0].apic_id = lapic_id();
+
+    idt_set_gate(IPI_RESCHED, apic241, KCODE_SEL, IDT_FLAGS_RING0);
+    idt_set_gate(IPI_TIMER, apic242, KCODE_SEL, IDT_FLAGS_RING0);
+
+    /* the APs run the trampoline with paging enabled for a few instructions,
+     * it must be identity mapped until they jumped to the kernel */
+    assert(kernel_directory->tables[0] == 0);
+    pte_t *page = get_page(AP_TRAMPOLINE, 1, kernel_directory);
+    map_page(page, 1, 1, AP_TRAMPOLINE);
+    memcpy((void *)PHYS_TO_VIRT(AP_TRAMPOLINE), ap_trampoline,
+           ap_trampoline_end - ap_trampoline);
+
+    for (i = 0; i < mp_info.num_cpus; ++i) {
+        uint8_t apic_id = mp_info.cpu_apic_ids[i];
+
+        if (apic_id == cpus[0].apic_id) {
+            continue;
+        }
+        if (num_cpus == MAX_CPUS) {
+            kprintf(WARNING, "[smp] Ignoring APIC %u, too many CPUs\n", apic_id);
+            continue;
+        }
+        if (smp_boot_ap(&cpus[num_cpus], apic_id)) {
+            ++num_cpus;
+        }
+    }
+
+    /* low memory belongs to user space again */
+    page->present = 0;
+    page->frame = 0;
+    kfree(kernel_directory->tables[0]);
+    kernel_directory->tables[0] = 0;
+    memset(&kernel_directory->entries[0], 0, sizeof(pde_t));
+    switch_page_directory(kernel_directory);
+
+    kprintf(INFO, "[smp] %u CPU(s) online\n", num_cpus);
+}
+
+void smp_send_resched(cpu_t *cpu)
+{
+    smp_send_ipi(cpu, IPI_RESCHED);
+}
+
+void smp_send_ipi(cpu_t *cpu, uint8_t vector)
+{
+    lapic_send_ipi(cpu->apic_id, vector);
+}
@@ -0,0 +1,74 @@
+#ifndef __KERNEL_SMP_H__
+#define __KERNEL_SMP_H__
+
+#include <types.h>
+#include <gdt.h>
+#include <scheduler.h>
+
+#define MAX_CPUS        8
+#define AP_TRAMPOLINE   0x8000  /* must match smpboot.s */
+
+#define IPI_RESCHED     0xf1    /* a thread was queued on another CPU */
+#define IPI_TIMER       0xf2    /* a timer expires before the programmed one-shot */
+
+struct thread;
+struct page_dir;
+
+/* gs points to the cpu_t of the CPU we run on, a field is read with a
+ * single instruction so it can't be torn by a migration */
+typedef struct cpu
+{
+    struct cpu      *self;      /* must stay first */
+    uint32_t        id;         /* index in cpus[] */
+    uint32_t        apic_id;
+    volatile int    started;
+    uintptr_t       stack;      /* boot stack, then the idle thread's */
+    struct thread   *fpu_owner; /* whose state is in this CPU's FPU */
+    int             nohz;       /* the periodic tick is stopped */
+    struct page_dir *page_dir;  /* loaded in cr3 */
+    uint32_t        irq_depth;  /* nested interrupt handlers */
+    uintptr_t       irq_stack;  /* top of the interrupt stack, 0 until allocated */
+    uint32_t        softirq_pending; /* bottom halves raised, one bit each */
+    int             in_softirq; /* running them, the thread can't be left */
+    uint32_t        nr_irqs;
+    uint32_t        nr_syscalls;
+    volatile uint32_t nr_resched; /* IPI_RESCHED taken, a sender may wait for it */
+    runqueue_t      rq;
+    gdt_entry_t     gdt[GDT_NUM_ENTRIES];
+    gdt_ptr_t       gdt_ptr;
+    tss_entry_t     tss;
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+extern uint32_t num_cpus;
+
+#define percpu_offset(field)    __builtin_offsetof(cpu_t, field)
+#define percpu_inc(field)       asm volatile ("incl %%gs:%c0" :: "i"(percpu_offset(field)) : "memory")
+#define percpu_dec(field)       asm volatile ("decl %%gs:%c0" :: "i"(percpu_offset(field)) : "memory")
+
+inline static cpu_t *this_cpu(void)
+{
+    cpu_t *cpu;
+    asm volatile ("movl %%gs:%c1, %0" : "=r"(cpu) : "i"(percpu_offset(self)));
+    return cpu;
+}
+
+inline static int in_interrupt(void)
+{
+    uint32_t depth;
+    asm volatile ("movl %%gs:%c1, %0" : "=r"(depth) : "i"(percpu_offset(irq_depth)));
+    return depth != 0;
+}
+
+inline static struct thread *this_cpu_current(void)
+{
+    struct thread *thread;
+    asm volatile ("movl %%gs:%c1, %0" : "=r"(thread) : "i"(percpu_offset(rq.current)));
+    return thread;
+}
+
+void smp_init(void);
+void smp_send_ipi(cpu_t *cpu, uint8_t vector);
+void smp_send_resched(cpu_t *cpu);
+
+#endif
@@ -0,0 +1,70 @@
+;===============================================================================
+; smpboot.s - real mode entry point of the application processors
+;===============================================================================
+
+; The code between ap_trampoline and ap_trampoline_end is copied to
+; AP_TRAMPOLINE in low memory by smp_init, the startup IPI makes the AP
+; execute it in real mode at AP_TRAMPOLINE:0000. Addresses are thus
+; computed relative to the copy and not to where the kernel was linked.
+
+AP_TRAMPOLINE   equ 0x8000
+%define REL(x)  (AP_TRAMPOLINE + (x) - ap_trampoline)
+
+[section .text]
+[bits 16]
+[global ap_trampoline]
+ap_trampoline:
+    cli
+    cld
+    xor     ax, ax
+    mov     ds, ax
+    lgdt    [REL(ap_gdt_ptr)]
+
+    mov     eax, cr0
+    or      eax, 1              ; protection enable
+    mov     cr0, eax
+    jmp     dword 0x08:REL(ap_protected)
+
+[bits 32]
+ap_protected:
+    mov     ax, 0x10
+    mov     ds, ax
+    mov     es, ax
+    mov     fs, ax
+    mov     gs, ax
+    mov     ss, ax
+
+    mov     eax, [REL(ap_boot_cr3)]
+    mov     cr3, eax            ; the kernel directory, low memory identity mapped
+    mov     eax, cr0
+    or      eax, 0x80000000     ; paging enable
+    mov     cr0, eax
+
+    mov     esp, [REL(ap_boot_stack)]
+    push    dword [REL(ap_boot_cpu)]
+    push    dword 0             ; ap_main never returns
+    mov     eax, [REL(ap_boot_entry)]
+    jmp     eax
+
+align 8
+ap_gdt:
+    dq      0x0000000000000000  ; null
+    dq      0x00cf9a000000ffff  ; flat code, ring 0
+    dq      0x00cf92000000ffff  ; flat data, ring 0
+ap_gdt_ptr:
+    dw      ap_gdt_ptr - ap_gdt - 1
+    dd      REL(ap_gdt)
+
+; filled in by smp_init for every AP
+[global ap_boot_cr3]
+[global ap_boot_stack]
+[global ap_boot_entry]
+[global ap_boot_cpu]
+align 4
+ap_boot_cr3:    dd 0
+ap_boot_stack:  dd 0
+ap_boot_entry:  dd 0
+ap_boot_cpu:    dd 0
+
+[global ap_trampoline_end]
+ap_trampoline_end:
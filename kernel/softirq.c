@@ -0,0 +1,47 @@
+#include <system.h>
+#include <softirq.h>
+#include <smp.h>
+
+static softirq_fn_t softirqs[NR_SOFTIRQS];
+
+void softirq_register(softirq_nr_t nr, softirq_fn_t fn)
+{
+    softirqs[nr] = fn;
+}
+
+/* called with interrupts disabled, usually from a top half */
+void softirq_raise(softirq_nr_t nr)
+{
+    asm volatile ("orl %0, %%gs:%c1"
+                  :: "r"(1 << nr), "i"(percpu_offset(softirq_pending)) : "memory");
+}
+
+/* On the way out of an interrupt, interrupts disabled. The bottom halves
+ * run with interrupts enabled, an interrupt arriving meanwhile only
+ * raises more of them since we don't nest. */
+void softirq_run(void)
+{
+    cpu_t *cpu = this_cpu();
+    uint32_t pending, restarts = SOFTIRQ_RESTARTS;
+    uint32_t nr;
+
+    if (cpu->in_softirq || !cpu->softirq_pending) {
+        return;
+    }
+    cpu->in_softirq = 1;
+
+    while ((pending = cpu->softirq_pending) && restarts--) {
+        cpu->softirq_pending = 0;
+        irq_enable();
+
+        for (nr = 0; pending; ++nr, pending >>= 1) {
+            if ((pending & 1) && softirqs[nr]) {
+                softirqs[nr]();
+            }
+        }
+
+        irq_disable();
+    }
+
+    cpu->in_softirq = 0;
+}
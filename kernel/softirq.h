@@ -0,0 +1,22 @@
+#ifndef __KERNEL_SOFTIRQ_H__
+#define __KERNEL_SOFTIRQ_H__
+
+#include <types.h>
+
+#define SOFTIRQ_RESTARTS    8   /* rounds before leaving the rest for the next IRQ */
+
+/* Bottom halves, raised by an interrupt handler and run on the same CPU
+ * once the handlers returned, with interrupts enabled. */
+typedef enum
+{
+    SOFTIRQ_KBD = 0,
+    NR_SOFTIRQS
+} softirq_nr_t;
+
+typedef void (*softirq_fn_t)(void);
+
+void softirq_register(softirq_nr_t nr, softirq_fn_t fn);
+void softirq_raise(softirq_nr_t nr);
+void softirq_run(void);
+
+#endif
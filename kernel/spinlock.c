@@ -0,0 +1,200 @@
+#include <system.h>
+#include <string.h>
+#include <spinlock.h>
+
+/* The statistics are only updated by the lock holder, except for the wait
+ * which is accounted once the lock is taken. Registered locks show up in
+ * lock_dump_stats(), the table is only ever appended to. */
+
+typedef struct
+{
+    const char   *name;
+    lock_stats_t *stats;
+} lock_entry_t;
+
+static lock_entry_t lock_table[LOCK_STATS_MAX];
+static volatile uint32_t num_locks = 0;
+
+inline static void cpu_relax(void)
+{
+    asm volatile ("pause" ::: "memory");
+}
+
+inline static void barrier(void)
+{
+    asm volatile ("" ::: "memory");
+}
+
+#ifdef LOCK_STATS
+inline static void stats_acquired(lock_stats_t *stats, uint64_t start)
+{
+    uint64_t now = get_cycles_count();
+
+    ++stats->acquired;
+    if (start) {
+        ++stats->contended;
+        stats->wait_cycles += now - start;
+    }
+    stats->stamp = now;
+}
+
+inline static void stats_released(lock_stats_t *stats)
+{
+    uint64_t held = get_cycles_count() - stats->stamp;
+
+    stats->hold_cycles += held;
+    if (held > stats->max_hold) {
+        stats->max_hold = held;
+    }
+}
+#else
+#define stats_acquired(stats, start)    do {} while (0)
+#define stats_released(stats)           do {} while (0)
+#endif
+
+void spin_lock_init(spinlock_t *lock, const char *name)
+{
+    lock->owner = 0;
+    lock->next = 0;
+    lock->name = name;
+#ifdef LOCK_STATS
+    memset(&lock->stats, 0, sizeof(lock_stats_t));
+#endif
+}
+
+void spin_lock(spinlock_t *lock)
+{
+    uint16_t ticket = __sync_fetch_and_add(&lock->next, 1);
+    uint64_t start = 0;
+
+    if (lock->owner != ticket) {
+        start = get_cycles_count();
+        while (lock->owner != ticket) {
+            cpu_relax();
+        }
+    }
+    barrier();
+    stats_acquired(&lock->stats, start);
+}
+
+/* the lock is free when no ticket is out, only take the next one then */
+int spin_trylock(spinlock_t *lock)
+{
+    uint16_t ticket = lock->next;
+
+    if (lock->owner != ticket ||
+        !__sync_bool_compare_and_swap(&lock->next, ticket, (uint16_t)(ticket + 1))) {
+        return 0;
+    }
+    stats_acquired(&lock->stats, 0);
+    return 1;
+}
+
+void spin_unlock(spinlock_t *lock)
+{
+    stats_released(&lock->stats);
+    barrier();
+    lock->owner = lock->owner + 1;
+}
+
+irq_state_t spin_lock_irqsave(spinlock_t *lock)
+{
+    irq_state_t irq_state = irq_save();
+    spin_lock(lock);
+    return irq_state;
+}
+
+void spin_unlock_irqrestore(spinlock_t *lock, irq_state_t irq_state)
+{
+    spin_unlock(lock);
+    irq_restore(irq_state);
+}
+
+void mcs_lock_init(mcs_lock_t *lock, const char *name)
+{
+    lock->tail = 0;
+    lock->name = name;
+#ifdef LOCK_STATS
+    memset(&lock->stats, 0, sizeof(lock_stats_t));
+#endif
+}
+
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node)
+{
+    mcs_node_t *prev;
+    uint64_t start = 0;
+
+    node->next = 0;
+    node->locked = 1;
+
+    prev = __sync_lock_test_and_set(&lock->tail, node);
+    if (prev) {
+        start = get_cycles_count();
+        prev->next = node;
+        while (node->locked) {
+            cpu_relax();
+        }
+    }
+    barrier();
+    stats_acquired(&lock->stats, start);
+}
+
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node)
+{
+    stats_released(&lock->stats);
+    barrier();
+
+    if (!node->next) {
+        if (__sync_bool_compare_and_swap(&lock->tail, node, 0)) {
+            return;
+        }
+        /* someone queued but didn't link itself yet */
+        while (!node->next) {
+            cpu_relax();
+        }
+    }
+    node->next->locked = 0;
+}
+
+irq_state_t mcs_lock_irqsave(mcs_lock_t *lock, mcs_node_t *node)
+{
+    irq_state_t irq_state = irq_save();
+    mcs_lock(lock, node);
+    return irq_state;
+}
+
+void mcs_unlock_irqrestore(mcs_lock_t *lock, mcs_node_t *node, irq_state_t irq_state)
+{
+    mcs_unlock(lock, node);
+    irq_restore(irq_state);
+}
+
+void lock_stats_register(const char *name, lock_stats_t *stats)
+{
+    uint32_t i = __sync_fetch_and_add(&num_locks, 1);
+
+    if (i >= LOCK_STATS_MAX) {
+        return;
+    }
+    lock_table[i].name = name;
+    lock_table[i].stats = stats;
+}
+
+void lock_dump_stats(void)
+{
+    uint32_t i, n = min(num_locks, LOCK_STATS_MAX);
+
+    /* cycle counts are shown in units of 1024 to stay in 32 bits */
+    kprintf(INFO, "[lock] name          acquired contended  wait(Kc)  hold(Kc)   max(c)\n");
+    for (i = 0; i < n; ++i) {
+        lock_stats_t *stats = lock_table[i].stats;
+        if (!stats) {
+            continue;
+        }
+        kprintf(INFO, "[lock] %-12s %9u %9u %9u %9u %8u\n",
+                lock_table[i].name, stats->acquired, stats->contended,
+                (uint32_t)(stats->wait_cycles >> 10),
+                (uint32_t)(stats->hold_cycles >> 10),
+                (uint32_t)stats->max_hold);
+    }
+}
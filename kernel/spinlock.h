@@ -0,0 +1,76 @@
+#ifndef __KERNEL_SPINLOCK_H__
+#define __KERNEL_SPINLOCK_H__
+
+#include <types.h>
+#include <system.h>
+
+#define LOCK_STATS          /* count contention and hold times */
+#define LOCK_STATS_MAX  32  /* locks that can be registered for the dump */
+
+typedef struct
+{
+    uint32_t acquired;
+    uint32_t contended;     /* had to wait for the lock */
+    uint64_t wait_cycles;
+    uint64_t hold_cycles;
+    uint64_t max_hold;
+    uint64_t stamp;         /* when the current holder got it */
+} lock_stats_t;
+
+/* Ticket lock, the CPUs get the lock in the order they asked for it. */
+typedef struct spinlock
+{
+    volatile uint16_t owner;    /* ticket being served */
+    volatile uint16_t next;     /* next ticket to hand out */
+    const char        *name;
+#ifdef LOCK_STATS
+    lock_stats_t      stats;
+#endif
+} spinlock_t;
+
+/* MCS queue lock, each waiter spins on its own node instead of the lock
+ * so a contended lock doesn't bounce between the caches. The node must
+ * live until the lock is released. */
+typedef struct mcs_node
+{
+    struct mcs_node *volatile next;
+    volatile int    locked;
+} mcs_node_t;
+
+typedef struct mcs_lock
+{
+    mcs_node_t *volatile tail;
+    const char          *name;
+#ifdef LOCK_STATS
+    lock_stats_t        stats;
+#endif
+} mcs_lock_t;
+
+#define SPINLOCK_INIT(n)    { .owner = 0, .next = 0, .name = (n) }
+#define MCS_LOCK_INIT(n)    { .tail = 0, .name = (n) }
+
+void spin_lock_init(spinlock_t *lock, const char *name);
+void spin_lock(spinlock_t *lock);
+int spin_trylock(spinlock_t *lock);
+void spin_unlock(spinlock_t *lock);
+irq_state_t spin_lock_irqsave(spinlock_t *lock);
+void spin_unlock_irqrestore(spinlock_t *lock, irq_state_t irq_state);
+
+void mcs_lock_init(mcs_lock_t *lock, const char *name);
+void mcs_lock(mcs_lock_t *lock, mcs_node_t *node);
+void mcs_unlock(mcs_lock_t *lock, mcs_node_t *node);
+irq_state_t mcs_lock_irqsave(mcs_lock_t *lock, mcs_node_t *node);
+void mcs_unlock_irqrestore(mcs_lock_t *lock, mcs_node_t *node, irq_state_t irq_state);
+
+void lock_stats_register(const char *name, lock_stats_t *stats);
+void lock_dump_stats(void);
+
+#ifdef LOCK_STATS
+#define spin_lock_register(lock)    lock_stats_register((lock)->name, &(lock)->stats)
+#define mcs_lock_register(lock)     lock_stats_register((lock)->name, &(lock)->stats)
+#else
+#define spin_lock_register(lock)    do {} while (0)
+#define mcs_lock_register(lock)     do {} while (0)
+#endif
+
+#endif
@@ -2,52 +2,207 @@
 //#include <logging.h>
 #include <vga.h>
 #include <thread.h>
+#include <scheduler.h>
 #include <syscall.h>
+#include <idt.h>
+#include <smp.h>
+#include <ring.h>
+#include <cpufeature.h>
+#include <string.h>
+#include <paging.h>
 
-DEFN_SYSCALL0(thread_exit, 0)
-DEFN_SYSCALL1(vga_print_str, 1, const char *)
-DEFN_SYSCALL1(vga_print_dec, 2, const uint32_t)
-DEFN_SYSCALL1(vga_print_hex, 3, const uint32_t)
+DEFN_SYSCALL0(thread_exit, SYSCALL_THREAD_EXIT)
+DEFN_SYSCALL1(vga_print_str, SYSCALL_VGA_PRINT_STR, const char *)
+DEFN_SYSCALL1(vga_print_dec, SYSCALL_VGA_PRINT_DEC, const uint32_t)
+DEFN_SYSCALL1(vga_print_hex, SYSCALL_VGA_PRINT_HEX, const uint32_t)
+DEFN_SYSCALL0(thread_yield, SYSCALL_THREAD_YIELD)
+DEFN_SYSCALL2(sched_stats, SYSCALL_SCHED_STATS, uint32_t, void *)
+DEFN_SYSCALL1(ring_setup, SYSCALL_RING_SETUP, uint32_t)
+DEFN_SYSCALL0(ring_enter, SYSCALL_RING_ENTER)
 
-static uintptr_t syscalls[] = 
+extern void sysenter_entry(void);
+extern int scheduling;
+
+int sysenter_enabled = 0;   /* read by the callers, user space included */
+
+/* nonzero if every page of the range is present and open to user space
+ * in the caller's directory, and writable if it is written to */
+static int user_range(uint32_t addr, size_t len, int write)
+{
+    page_dir_t *dir = get_current_thread()->page_dir;
+    uint32_t page, last = addr + len - 1;
+    pte_t *pte;
+
+    if (len == 0 || last < addr) {
+        return 0;
+    }
+    for (page = addr & ~(FRAME_SIZE - 1); ; page += FRAME_SIZE) {
+        if (!dir->tables[page >> 22]) {
+            return 0;
+        }
+        pte = get_page(page, 0, dir);
+        if (!pte->present || !pte->user_supervisor || (write && !pte->read_write)) {
+            return 0;
+        }
+        if (last - page < FRAME_SIZE) {
+            return 1;
+        }
+    }
+}
+
+/* nonzero if the string up to its null is readable by the caller */
+static int user_string(uint32_t addr)
 {
-    (uintptr_t)&thread_exit,
-    (uintptr_t)&vga_print_str,
-    (uintptr_t)&vga_print_dec,
-    (uintptr_t)&vga_print_hex
+    for (;; ++addr) {
+        if (!user_range(addr, 1, 0)) {
+            return 0;
+        }
+        /* the rest of the page is known to be there */
+        for (; *(const char *)addr; ++addr) {
+            if ((addr & (FRAME_SIZE - 1)) == FRAME_SIZE - 1) {
+                break;
+            }
+        }
+        if (!*(const char *)addr) {
+            return 1;
+        }
+    }
+}
+
+static int sys_thread_exit(uint32_t p1, uint32_t p2, uint32_t p3, uint32_t p4, uint32_t p5)
+{
+    thread_exit();
+    return 0;
+}
+
+static int sys_vga_print_str(uint32_t p1, uint32_t p2, uint32_t p3, uint32_t p4, uint32_t p5)
+{
+    if (!user_string(p1)) {
+        return -1;
+    }
+    vga_print_str((const char *)p1);
+    return 0;
+}
+
+static int sys_vga_print_dec(uint32_t p1, uint32_t p2, uint32_t p3, uint32_t p4, uint32_t p5)
+{
+    vga_print_dec(p1);
+    return 0;
+}
+
+static int sys_vga_print_hex(uint32_t p1, uint32_t p2, uint32_t p3, uint32_t p4, uint32_t p5)
+{
+    vga_print_hex(p1);
+    return 0;
+}
+
+static int sys_thread_yield(uint32_t p1, uint32_t p2, uint32_t p3, uint32_t p4, uint32_t p5)
+{
+    thread_yield();
+    return 0;
+}
+
+/* gathered under the scheduler lock, copied out once it is released */
+static int sys_sched_stats(uint32_t p1, uint32_t p2, uint32_t p3, uint32_t p4, uint32_t p5)
+{
+    sched_stats_t stats;
+
+    if (!user_range(p2, sizeof(stats), 1)) {
+        return -1;
+    }
+    if (sched_get_stats(p1, &stats) != 0) {
+        return -1;
+    }
+    memcpy((void *)p2, &stats, sizeof(stats));
+    return 0;
+}
+
+static int sys_ring_setup(uint32_t p1, uint32_t p2, uint32_t p3, uint32_t p4, uint32_t p5)
+{
+    return (int)ring_setup(p1);
+}
+
+static int sys_ring_enter(uint32_t p1, uint32_t p2, uint32_t p3, uint32_t p4, uint32_t p5)
+{
+    return ring_enter();
+}
+
+static const syscall_fn_t syscalls[] =
+{
+    sys_thread_exit,
+    sys_vga_print_str,
+    sys_vga_print_dec,
+    sys_vga_print_hex,
+    sys_thread_yield,
+    sys_sched_stats,
+    sys_ring_setup,
+    sys_ring_enter
 };
 
-uint32_t num_syscalls = 4;
+#define NUM_SYSCALLS    (sizeof(syscalls) / sizeof(syscalls[0]))
 
 static void syscall_handler(registers_t *regs);
 
+/* SYSENTER takes its stack from the MSR, which points at the TSS field
+ * holding the current thread's kernel stack. It is updated on every
+ * switch anyway, so the MSR never changes. */
+void syscall_init_ap(void)
+{
+    if (!sysenter_enabled) {
+        return;
+    }
+    wrmsr(MSR_SYSENTER_CS, KCODE_SEL);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)&this_cpu()->tss.esp0);
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+}
+
 void syscall_init()
 {
+    uint32_t a = cpu_signature;
+
     attach_interrupt_handler(SYSCALL_VECTOR, &syscall_handler);
+
+    /* the early Pentium Pro report SEP without supporting it */
+    if (cpu_has(CPU_SEP) && !(((a >> 8) & 0xf) == 6 && ((a >> 4) & 0xf) < 3 && (a & 0xf) < 3)) {
+        sysenter_enabled = 1;
+        syscall_init_ap();
+        kprintf(INFO, "[syscall] SYSENTER enabled\n");
+    }
 }
 
-void syscall_handler(registers_t *regs)
+int syscall_dispatch(uint32_t num, uint32_t p1, uint32_t p2, uint32_t p3, uint32_t p4, uint32_t p5)
 {
-    if (regs->eax >= num_syscalls) {
-        return;
+    percpu_inc(nr_syscalls);
+    if (num >= NUM_SYSCALLS) {
+        return -1;
     }
+    return syscalls[num](p1, p2, p3, p4, p5);
+}
 
-    uintptr_t syscall = syscalls[regs->eax];
-
-    int ret;
-    asm volatile (
-            "push %1    \n"
-            "push %2    \n"
-            "push %3    \n"
-            "push %4    \n"
-            "push %5    \n"
-            "call *%6   \n"
-            "pop %%ebx  \n"
-            "pop %%ebx  \n"
-            "pop %%ebx  \n"
-            "pop %%ebx  \n"
-            "pop %%ebx  \n"
-            : "=a"(ret) : "r"(regs->edi), "r"(regs->esi), "r"(regs->edx), 
-                          "r"(regs->ecx), "r"(regs->ebx), "r"(syscall));
-    regs->eax = ret;
+/* SYSENTER leaves the return address, edx and ecx on the user stack at
+ * frame, it is checked before anything is read from it. A caller whose
+ * frame isn't its own can't be returned to and is ended. */
+int sysenter_dispatch(uint32_t num, uint32_t p1, const uint32_t *frame, uint32_t p4, uint32_t p5)
+{
+    if (!user_range((uint32_t)frame, 3 * sizeof(uint32_t), 0)) {
+        kprintf(WARNING, "[syscall] Bad SYSENTER frame %x in thread %u\n", frame, getpid());
+        thread_exit();
+    }
+    return syscall_dispatch(num, p1, frame[2], frame[1], p4, p5);
+}
+
+/* on the way back to the caller, with interrupts disabled: a thread the
+ * system call woke may preempt it */
+void syscall_exit(void)
+{
+    if (scheduling) {
+        schedule_irq_exit();
+    }
+}
+
+void syscall_handler(registers_t *regs)
+{
+    regs->eax = syscall_dispatch(regs->eax, regs->ebx, regs->ecx, regs->edx,
+                                 regs->esi, regs->edi);
+    syscall_exit();
 }
@@ -1,7 +1,59 @@
 #ifndef __KERNEL_SYSCALL_H__
 #define __KERNEL_SYSCALL_H__
 
+#include <types.h>
+
+#define MSR_SYSENTER_CS     0x174
+#define MSR_SYSENTER_ESP    0x175
+#define MSR_SYSENTER_EIP    0x176
+
+#define SYSCALL_THREAD_EXIT     0
+#define SYSCALL_VGA_PRINT_STR   1
+#define SYSCALL_VGA_PRINT_DEC   2
+#define SYSCALL_VGA_PRINT_HEX   3
+#define SYSCALL_THREAD_YIELD    4
+#define SYSCALL_SCHED_STATS     5
+#define SYSCALL_RING_SETUP      6
+#define SYSCALL_RING_ENTER      7
+
+typedef int (*syscall_fn_t)(uint32_t, uint32_t, uint32_t, uint32_t, uint32_t);
+
+extern int sysenter_enabled;
+
 void syscall_init(void);
+void syscall_init_ap(void);
+int syscall_dispatch(uint32_t num, uint32_t p1, uint32_t p2, uint32_t p3, uint32_t p4, uint32_t p5);
+int sysenter_dispatch(uint32_t num, uint32_t p1, const uint32_t *frame, uint32_t p4, uint32_t p5);
+void syscall_exit(void);
+
+/* Ring 3 callers enter with SYSENTER when the CPU has it. The return
+ * address, ecx, edx and ebp are saved on the user stack, ebp points to
+ * them for the kernel which returns with SYSEXIT right after sysenter.
+ * Kernel threads have no separate stack to switch to and use int 0x80. */
+inline static int syscall_raw(uint32_t num, uint32_t p1, uint32_t p2, uint32_t p3, uint32_t p4, uint32_t p5)
+{
+    int a;
+    uint16_t cs;
+
+    asm volatile ("mov %%cs, %0" : "=r"(cs));
+    if (sysenter_enabled && (cs & 3)) {
+        asm volatile ("push %%ebp       \n"
+                      "push %%ecx       \n"
+                      "push %%edx       \n"
+                      "push $1f         \n"
+                      "mov %%esp, %%ebp \n"
+                      "sysenter         \n"
+                      "1:               \n"
+                      "pop %%edx        \n"
+                      "pop %%ecx        \n"
+                      "pop %%ebp        \n"
+                      : "=a"(a) : "0"(num), "b"(p1), "c"(p2), "d"(p3), "S"(p4), "D"(p5) : "memory");
+    } else {
+        asm volatile ("int $0x80"
+                      : "=a"(a) : "0"(num), "b"(p1), "c"(p2), "d"(p3), "S"(p4), "D"(p5) : "memory");
+    }
+    return a;
+}
 
 #define DECL_SYSCALL0(fn) int syscall_##fn(void);
 #define DECL_SYSCALL1(fn, P1) int syscall_##fn(P1);
@@ -12,41 +64,39 @@ void syscall_init(void);
 
 #define DEFN_SYSCALL0(fn, num) \
     inline int syscall_##fn(void) { \
-        int a; asm volatile("int $0x80" : "=a" (a) : "0" (num)); \
-        return a; \
+        return syscall_raw(num, 0, 0, 0, 0, 0); \
     }
 
 #define DEFN_SYSCALL1(fn, num, P1) \
     inline int syscall_##fn(P1 p1) { \
-        int a; asm volatile("int $0x80" : "=a" (a) : "0" (num), "b" ((int)p1)); \
-        return a; \
+        return syscall_raw(num, (uint32_t)p1, 0, 0, 0, 0); \
     }
 
 #define DEFN_SYSCALL2(fn, num, P1, P2) \
     inline int syscall_##fn(P1 p1, P2 p2) { \
-        int a; asm volatile("int $0x80" : "=a" (a) : "0" (num), "b" ((int)p1), "c" ((int)p2)); \
-        return a; \
+        return syscall_raw(num, (uint32_t)p1, (uint32_t)p2, 0, 0, 0); \
     }
 
 #define DEFN_SYSCALL3(fn, num, P1, P2, P3) \
     inline int syscall_##fn(P1 p1, P2 p2, P3 p3) { \
-        int a; asm volatile("int $0x80" : "=a" (a) : "0" (num), "b" ((int)p1), "c" ((int)p2), "d"((int)p3)); \
-        return a; \
+        return syscall_raw(num, (uint32_t)p1, (uint32_t)p2, (uint32_t)p3, 0, 0); \
     }
 
 #define DEFN_SYSCALL4(fn, num, P1, P2, P3, P4) \
     inline int syscall_##fn(P1 p1, P2 p2, P3 p3, P4 p4) { \
-        int a; asm volatile("int $0x80" : "=a" (a) : "0" (num), "b" ((int)p1), "c" ((int)p2), "d"((int)p3), "S" ((int)p4)); \
-        return a; \
+        return syscall_raw(num, (uint32_t)p1, (uint32_t)p2, (uint32_t)p3, (uint32_t)p4, 0); \
+    }
 
 #define DEFN_SYSCALL5(fn, num, P1, P2, P3, P4, P5) \
     inline int syscall_##fn(P1 p1, P2 p2, P3 p3, P4 p4, P5 p5) { \
-        int a; asm volatile("int $0x80" : "=a" (a) : "0" (num), "b" ((int)p1), "c" ((int)p2), "d"((int)p3), "S" ((int)p4), "D" ((int)p5)); \
-        return a; \
+        return syscall_raw(num, (uint32_t)p1, (uint32_t)p2, (uint32_t)p3, (uint32_t)p4, (uint32_t)p5); \
+    }
 
 DECL_SYSCALL0(thread_exit)
 DECL_SYSCALL1(vga_print_str, const char *)
 DECL_SYSCALL1(vga_print_dec, const uint32_t)
 DECL_SYSCALL1(vga_print_hex, const uint32_t)
+DECL_SYSCALL0(thread_yield)
+DECL_SYSCALL2(sched_stats, uint32_t, void *)
 
 #endif
@@ -5,45 +5,101 @@
 #include <pit.h>
 #include <logging.h>
 #include <scheduler.h>
-
-#define MAX_HANDLERS 50
-
-static handler_t handlers[IDT_NUM_ENTRIES][MAX_HANDLERS];
-static uint32_t handlers_heads[IDT_NUM_ENTRIES] = { 0 };
+#include <timer.h>
+#include <fpu.h>
+#include <lapic.h>
+#include <smp.h>
+#include <mp.h>
+#include <ioapic.h>
+#include <cpufeature.h>
+#include <softirq.h>
+#include <spinlock.h>
+#include <kheap.h>
+#include <trace.h>
+
+#define IMCR_ADDR   0x22
+#define IMCR_DATA   0x23
+
+static irq_desc_t irq_descs[IDT_NUM_ENTRIES];
+static irq_stats_t irq_stats[MAX_CPUS][IDT_NUM_ENTRIES];
+static spinlock_t irq_desc_lock = SPINLOCK_INIT("irq desc");
 
 static void dump_registers(registers_t *regs);
 extern char *exception_messages[];
 
 extern int scheduling;
-extern tss_entry_t tss_entry;
 
-inline void spin_lock(uint8_t volatile *lock) {
-    while (__sync_lock_test_and_set(lock, 0x01)) {
-    }
-}
-
-inline void spin_unlock(uint8_t volatile *lock) {
-    __sync_lock_release(lock);
-}
+static int use_apic = 0;    /* IRQs come through the IO-APIC */
 
 inline void set_kernel_stack(uintptr_t stack)
 {
-    tss_entry.esp0 = (uint32_t)stack; 
+    this_cpu()->tss.esp0 = (uint32_t)stack; 
 }
 
 void arch_init()
 {
+    cpu_features_init();
+
     gdt_init();
     idt_init();
     kprintf(INFO, "[system] GDT/IDT initialized\n");
 
+    fpu_init();
+
     pic_init();
     kprintf(INFO, "[system] PIC initialized\n");
 
     pit_init(TIMER_FREQ);
+    timer_init();
     kprintf(INFO, "[system] PIT initialized\n");
 }
 
+/* Hand the ISA IRQs over to the IO-APIC and the clock over to the local
+ * APIC timer. Without an APIC or MP table the PIC and PIT stay in charge. */
+void arch_init_apic()
+{
+    uint16_t pic_mask;
+    uint8_t irq;
+
+    if (!lapic_present() || mp_init() != 0 || !mp_info.ioapic_base) {
+        kprintf(INFO, "[system] No APIC, staying with the PIC\n");
+        return;
+    }
+
+    lapic_init(mp_info.lapic_base);
+    lapic_timer_init();
+
+    irq_state_t irq_state = irq_save();
+
+    pic_mask = pic_get_mask();
+    pic_disable();
+    pic_disable_irq(PIC_INDEX_SLAVE);
+    if (mp_info.imcr) {
+        /* route the interrupts from the PIC to the APIC */
+        outb(IMCR_ADDR, 0x70);
+        outb(IMCR_DATA, 0x01);
+    }
+
+    ioapic_init(mp_info.ioapic_base);
+    for (irq = 0; irq < 16; ++irq) {
+        if (irq == PIC_INDEX_SLAVE) {
+            continue;
+        }
+        ioapic_route_irq(irq, mp_info.isa_pin[irq], IRQ(irq),
+                         lapic_id(), mp_info.isa_flags[irq]);
+        /* the PIT is no longer needed once the local timer keeps the time */
+        if (irq != IRQ_TIMER && !(pic_mask & (1 << irq))) {
+            ioapic_enable_irq(irq);
+        }
+    }
+    use_apic = 1;
+
+    irq_restore(irq_state);
+    kprintf(INFO, "[system] IO-APIC initialized\n");
+
+    timer_set_clock(&lapic_clock);
+}
+
 void arch_finish()
 {
     pic_disable();
@@ -68,115 +124,140 @@ void arch_reset()
     stop();
 }
 
-void attach_interrupt_handler(uint8_t num, isr_t handler)
+/* The dispatchers read the descriptors without locking. The sequence is
+ * odd while a descriptor changes and moves on once it is done, a
+ * dispatcher takes a copy of the handlers and takes it again if the
+ * sequence moved meanwhile. A detached handler may still run once on
+ * another CPU which took its copy before. */
+static void irq_desc_begin(irq_desc_t *desc)
 {
-    handler_t *h = 0, *n = 0;
-    uint8_t i = 0;
-    uint32_t head;
+    ++desc->seq;
+    __sync_synchronize();
+}
 
-    /* get the head */
-    head = handlers_heads[num];
-    h = &handlers[num][head];
+static void irq_desc_end(irq_desc_t *desc)
+{
+    __sync_synchronize();
+    ++desc->seq;
+}
 
-    /* null h if the list is empty */
-    if (!h->handler) {
-        h = 0;
-    }
+void attach_interrupt_handler(uint8_t num, isr_t handler)
+{
+    irq_desc_t *desc = &irq_descs[num];
+    irq_state_t irq_state = spin_lock_irqsave(&irq_desc_lock);
 
-    /* find the tail */
-    while (h && h->next) {
-        h = h->next;
+    if (desc->count == IRQ_MAX_SHARED) {
+        spin_unlock_irqrestore(&irq_desc_lock, irq_state);
+        kprintf(WARNING, "[system] Too many handlers for vector %u\n", num);
+        return;
     }
+    irq_desc_begin(desc);
+    desc->handlers[desc->count] = handler;
+    ++desc->count;
+    irq_desc_end(desc);
 
-    /* h now points to the last interrupt handler structure
-     * or is 0 if none has been registered yet */
+    spin_unlock_irqrestore(&irq_desc_lock, irq_state);
+}
 
-    /* find a free slot */
-    for (i = 0; i < MAX_HANDLERS; ++i) {
-        if (handlers[num][i].handler == 0) {
-            n = &handlers[num][i];
+void detach_interrupt_handler(uint8_t num, isr_t handler)
+{
+    irq_desc_t *desc = &irq_descs[num];
+    uint32_t i;
+    irq_state_t irq_state = spin_lock_irqsave(&irq_desc_lock);
+
+    for (i = 0; i < desc->count; ++i) {
+        if (desc->handlers[i] == handler) {
+            irq_desc_begin(desc);
+            /* keep the order, the clock handlers rely on it */
+            for (; i + 1 < desc->count; ++i) {
+                desc->handlers[i] = desc->handlers[i + 1];
+            }
+            --desc->count;
+            irq_desc_end(desc);
             break;
         }
     }
-    /* attach handler if a slot is available */
-    if (n) {
-        irq_state_t irq_state = irq_save();
-        n->handler = handler;
-        n->num = num;
-        n->next = 0;
-        if (h) {
-            n->index = h->index + 1;
-            n->prev = h;
-            n->prev->next = n;
-        } else {
-            n->index = 1;
-            n->prev = 0;
-        }
-        irq_restore(irq_state);
-    }
+
+    spin_unlock_irqrestore(&irq_desc_lock, irq_state);
 }
 
-void detach_interrupt_handler(uint8_t num, isr_t handler)
+/* returns the number of handlers called */
+inline static uint32_t dispatch_interrupt(registers_t *regs)
 {
-    /* get the head */
-    uint32_t head = handlers_heads[num];
-    handler_t *h = &handlers[num][head];
+    irq_desc_t *desc = &irq_descs[regs->int_no];
+    irq_stats_t *stats = &irq_stats[this_cpu()->id][regs->int_no];
+    isr_t handlers[IRQ_MAX_SHARED];
+    uint32_t i, seq, count;
+#ifdef IRQ_STATS
+    uint64_t start = get_cycles_count();
+#endif
 
-    /* check for empty list */
-    if (!h->handler) {
-        return;
-    }
-
-    /* go to the tail */
-    while (h->next) {
-        h = h->next;
-    }
-
-    /* go through the list from tail to head and look for handler */
     do {
-        if (h->handler == handler) {
-            irq_state_t irq_state = irq_save();
-            if (h->prev) {
-                h->prev->next = h->next;
-            }
-            if (h->next) {
-                h->next->prev = h->prev;
-                /* If we are removing the head we need
-                 * to update handlers_heads accordingly. */
-                if (!h->prev) {
-                    /* Since the array is static it is guaranteed
-                     * to be contiguous */
-                    handlers_heads[num] = (uint32_t)(h->next - &handlers[num][0]);
-                    /* if h->next is 0, the list is empty and head will be 0 */
-                }
-            }
-            h->handler = 0;
-            irq_restore(irq_state);
-            break;
+        seq = desc->seq;
+        asm volatile ("" ::: "memory");
+        count = desc->count;
+        for (i = 0; i < count; ++i) {
+            handlers[i] = desc->handlers[i];
+        }
+        asm volatile ("" ::: "memory");
+    } while ((seq & 1) || seq != desc->seq);
+
+    ++stats->hits;
+    trace("int %u handlers %u", regs->int_no, count);
+    if (count == 1) {
+        handlers[0](regs);
+    } else if (count == 0) {
+        ++stats->spurious;
+    } else {
+        for (i = 0; i < count; ++i) {
+            handlers[i](regs);
         }
-    } while ((h = h->prev) != 0);
+    }
+
+#ifdef IRQ_STATS
+    stats->cycles += get_cycles_count() - start;
+#endif
+    return count;
 }
 
-handler_t *get_interrupt_handler(uint8_t num)
+void irq_dump_stats(void)
 {
-    uint32_t head = handlers_heads[num];
-    handler_t *h = &handlers[num][head];
-
-    if (h->handler) {
-        return h;
-    } else {
-        return 0;
+    uint32_t vec, i, hits, spurious;
+    uint64_t cycles;
+
+    /* cycle counts are shown in units of 1024 to stay in 32 bits */
+    kprintf(INFO, "[irq] vec       hits  spurious cycles(Kc)\n");
+    for (vec = 0; vec < IDT_NUM_ENTRIES; ++vec) {
+        hits = spurious = 0;
+        cycles = 0;
+        for (i = 0; i < num_cpus; ++i) {
+            hits += irq_stats[i][vec].hits;
+            spurious += irq_stats[i][vec].spurious;
+            cycles += irq_stats[i][vec].cycles;
+        }
+        if (hits) {
+            kprintf(INFO, "[irq] %3u %10u %9u %10u\n",
+                    vec, hits, spurious, (uint32_t)(cycles >> 10));
+        }
     }
 }
 
 inline void enable_irq(uint8_t irq)
 {
-    pic_enable_irq(irq);
+    if (use_apic) {
+        ioapic_enable_irq(irq);
+    } else {
+        pic_enable_irq(irq);
+    }
 }
 
 inline void disable_irq(uint8_t irq)
 {
-    pic_disable_irq(irq);
+    if (use_apic) {
+        ioapic_disable_irq(irq);
+    } else {
+        pic_disable_irq(irq);
+    }
 }
 
 inline void disable_irqs()
@@ -191,16 +272,21 @@ inline void restore_irqs()
 
 inline void sleep(uint32_t ms)
 {
-    uint32_t current = pit_get_ticks();
+    if (scheduling) {
+        thread_sleep(ms);
+        return;
+    }
+
+    uint32_t current = timer_get_ticks();
 
-    while (current + ms > pit_get_ticks()) {
+    while (current + ms > timer_get_ticks()) {
         halt();
     }
 }
 
 inline uint32_t get_ticks_count()
 {
-    return pit_get_ticks();
+    return timer_get_ticks();
 }
 
 inline uint64_t get_cycles_count()
@@ -215,25 +301,26 @@ void cpuid(int code, uint32_t *a, uint32_t *d)
     asm volatile ("cpuid" : "=a"(*a), "=d"(*d) : "0"(code) : "ebx", "ecx");
 }
 
+uint64_t rdmsr(uint32_t msr)
+{
+    uint64_t value;
+    asm volatile ("rdmsr" : "=A"(value) : "c"(msr));
+    return value;
+}
+
+void wrmsr(uint32_t msr, uint64_t value)
+{
+    asm volatile ("wrmsr" :: "c"(msr), "A"(value));
+}
+
 uintptr_t isr_handler(registers_t *regs)
 {
     uintptr_t esp = (uintptr_t)regs;
-    uint8_t stop = 0;
-
-    handler_t *h = get_interrupt_handler(regs->int_no);
+    uint32_t count = dispatch_interrupt(regs);
 
-    if (!h /* no handler */
+    if (!count /* no handler */
         || regs->int_no == 8 /* double fault */
         || (regs->int_no >= IRQ(0) && regs->int_no != SYSCALL_VECTOR)) {/* unexpected int. no */
-        stop = 1;
-    }
-
-    while (h) {
-        h->handler(regs);
-        h = h->next;
-    }
-
-    if (stop) {
         kprintf(ERROR, "\033\014Unhandled exception #%u", regs->int_no);
         if (regs->int_no < IRQ(0)) {
             kprintf(ERROR, " (%s)", exception_messages[regs->int_no]);
@@ -246,29 +333,94 @@ uintptr_t isr_handler(registers_t *regs)
     return esp;
 }
 
+void irq_stack_init(cpu_t *cpu)
+{
+    uintptr_t stack = (uintptr_t)kmalloc(IRQ_STACK_SIZE);
+
+    assert(stack != 0);
+    cpu->irq_stack = stack + IRQ_STACK_SIZE;
+}
+
+/* the handlers and bottom halves of an IRQ run with the frame in regs */
+static void irq_run(void *data)
+{
+    registers_t *regs = (registers_t *)data;
+
+    percpu_inc(irq_depth);
+    if (!dispatch_interrupt(regs) && regs->int_no != IRQ(IRQ_TIMER)) {
+        kprintf(WARNING, "\033\014No handler for IRQ #%u\n\033\017", regs->int_no - IRQ(0));
+    }
+    percpu_dec(irq_depth);
+    softirq_run();
+}
+
+/* Only the frame goes on the interrupted thread's stack, the handlers run
+ * on the CPU's interrupt stack so a thread's stack needn't make room for
+ * them. Interrupts nested in the bottom halves are already on it. Nothing
+ * switches threads until we are back on the thread's stack. */
+static void irq_run_on_stack(registers_t *regs)
+{
+    uintptr_t top = this_cpu()->irq_stack;
+    uintptr_t esp = (uintptr_t)&top;
+
+    if (!top || (esp < top && esp >= top - IRQ_STACK_SIZE)) {
+        irq_run(regs);
+    } else {
+        call_on_stack(irq_run, regs, top);
+    }
+}
+
 uintptr_t irq_handler(registers_t *regs)
 {
     uintptr_t esp = (uintptr_t)regs;
-    handler_t *h = 0;
+    uint32_t irq = regs->int_no;
 
-    if (pic_acknowledge(regs->int_no)) {
-        kprintf(DEBUG, "\033\014Spurious IRQ\n\033\017");
+    if (use_apic) {
+        lapic_eoi();
+    } else if (pic_acknowledge(irq)) {
+        ++irq_stats[this_cpu()->id][IRQ(irq)].spurious;
         return esp; /* ignore spurious IRQs */
     }
-
-    if (scheduling && regs->int_no == 0) {
-        /* execute scheduler and overwrite esp */
-        esp = schedule_tick(regs);
+    percpu_inc(nr_irqs);
+
+    /* the handlers are indexed by vector */
+    regs->int_no = IRQ(irq);
+    irq_run_on_stack(regs);
+    regs->int_no = irq;
+
+    /* the handlers must run before we may leave this thread, a bottom
+     * half interrupted here must finish on this CPU first */
+    if (scheduling && !this_cpu()->in_softirq) {
+        if (regs->int_no == IRQ_TIMER && !use_apic) {
+            esp = schedule_tick(regs);
+        } else {
+            schedule_irq_exit();
+        }
     }
 
-    h = get_interrupt_handler(IRQ(regs->int_no));
-    if (!h && regs->int_no != 0) {
-        kprintf(WARNING, "\033\014No handler for IRQ #%u\n\033\017", regs->int_no);
-        return esp;
+    return esp;
+}
+
+uintptr_t apic_handler(registers_t *regs)
+{
+    uintptr_t esp = (uintptr_t)regs;
+
+    lapic_eoi();
+    percpu_inc(nr_irqs);
+    if (regs->int_no == IPI_RESCHED) {
+        percpu_inc(nr_resched);
     }
-    while (h) {
-        h->handler(regs);
-        h = h->next;
+
+    irq_run_on_stack(regs);
+
+    if (scheduling && !this_cpu()->in_softirq) {
+        if (regs->int_no == LAPIC_TIMER) {
+            esp = schedule_tick(regs);
+        } else if (regs->int_no == IPI_RESCHED) {
+            schedule_ipi();
+        } else {
+            schedule_irq_exit();
+        }
     }
 
     return esp;
@@ -10,6 +10,7 @@
 #define IRQ(x)          ((x) + 0x20)
 #define SYSCALL_VECTOR  0x80
 #define TIMER_FREQ      1000
+#define TIMER_NOHZ      /* stop the periodic tick when there is no one to preempt */
 #define IRQ_TIMER       0
 
 #define min(x, y)       ((x) < (y) ? (x) : (y))
@@ -21,6 +22,9 @@
     #define DBPRINT(...)    do {} while (0)
 #endif
 
+#define EFLAGS_IF       (1 << 9)    /* interrupts enabled */
+#define IRQ_STACK_SIZE  0x4000      /* per CPU, the IRQ handlers run on it */
+
 typedef uint32_t irq_state_t;
 
 /*
@@ -94,10 +98,6 @@ inline static void stop()
     } \
 }
 
-// TODO: implement mutex like locklessinc.com/articles/locks/
-void spin_lock(uint8_t volatile *lock);
-void spin_unlock(uint8_t volatile *lock);
-
 void gdt_flush(void *pointer); /* XXX: should be in gdt.h */
 void idt_flush(void *pointer); /* XXX: should be in idt.h */
 void tss_flush(); /* XXX: should be in tss.h */
@@ -112,15 +112,27 @@ typedef struct registers
 } registers_t;
 
 typedef void (*isr_t)(registers_t *);
-typedef struct handler_s
+
+#define IRQ_MAX_SHARED  4       /* handlers sharing a vector */
+#define IRQ_STATS               /* count the cycles spent in the handlers */
+
+/* what to call for a vector, almost always a single handler */
+typedef struct irq_desc
+{
+    volatile uint32_t seq;      /* odd while the handlers change */
+    volatile uint32_t count;
+    isr_t             handlers[IRQ_MAX_SHARED];
+} irq_desc_t;
+
+typedef struct
 {
-    isr_t handler;
-    uint8_t num;
-    uint32_t index;
-    struct handler_s *next, *prev;
-} handler_t;
+    uint32_t hits;
+    uint32_t spurious;      /* nobody handled it */
+    uint64_t cycles;
+} irq_stats_t;
 
 void arch_init();
+void arch_init_apic();
 void arch_finish();
 void arch_reset();
 
@@ -131,13 +143,21 @@ void restore_irqs();
 
 void attach_interrupt_handler(uint8_t num, isr_t handler);
 void detach_interrupt_handler(uint8_t num, isr_t handler);
-handler_t *get_interrupt_handler(uint8_t num);
+void irq_dump_stats(void);
+struct cpu;
+void irq_stack_init(struct cpu *cpu);
+void call_on_stack(void (*fn)(void *), void *arg, uintptr_t stack_top);
 void interrupt(int no);
+void switch_context(uintptr_t *old_esp, uintptr_t new_esp);
 
 uint32_t get_ticks_count();
 uint64_t get_cycles_count();
 
 void cpuid(int code, uint32_t *a, uint32_t *d);
+void cpu_features_init(void);
+extern uint32_t cpu_signature;  /* family, model and stepping */
+uint64_t rdmsr(uint32_t msr);
+void wrmsr(uint32_t msr, uint64_t value);
 
 void sleep(uint32_t ms);
 void io_wait();
@@ -5,19 +5,22 @@
 #include <string.h>
 #include <paging.h>
 #include <thread.h>
+#include <fpu.h>
+#include <smp.h>
+#include <tracepoint.h>
 
-#define STACK_SIZE 0x2000
-#define stack_top(s) ((s) + STACK_SIZE)
+DEFINE_TRACEPOINT(thread, create);
+DEFINE_TRACEPOINT(thread, destroy);
+
+extern void thread_trampoline(void);
 
 uint32_t num_threads = 0;
-extern thread_t *current_thread;
-extern page_dir_t *current_directory;
 extern page_dir_t *kernel_directory;
 
 static uint32_t request_thread_id()
 {
     static uint32_t id = 0;
-    return ++id;
+    return __sync_add_and_fetch(&id, 1);
 }
 
 uint32_t get_num_threads()
@@ -37,18 +40,18 @@ void create_kernel_thread(void)
 
     thread->id = request_thread_id();
     thread->process = 0;
-    thread->page_dir = current_directory;
+    thread->page_dir = this_cpu()->page_dir;
 
-    ++num_threads;
+    __sync_add_and_fetch(&num_threads, 1);
 
-    schedule_thread(thread);
+    schedule_current(thread);
 
     irq_restore(irq_state);
 }
 
 #define PUSH(stack, x) (*--(stack) = x)
 
-uint32_t create_thread(process_t *process, entry_t entry, void *args, uint32_t priority, int user, int vm86)
+static thread_t *new_thread(process_t *process, entry_t entry, void *args, uint32_t priority, int user, int vm86)
 {
     /* create thread */
     thread_t *thread = (thread_t *)kmalloc(sizeof(thread_t));
@@ -58,7 +61,7 @@ uint32_t create_thread(process_t *process, entry_t entry, void *args, uint32_t p
     memset(thread, 0, sizeof(thread_t));
 
     /* setup the stack(s) */
-    thread->kstack = (uintptr_t)kmalloc(STACK_SIZE);
+    thread->kstack = (uintptr_t)kmalloc(KSTACK_SIZE);
     /*
     if (user) {
         uint32_t *stack = (uint32_t *)thread->kstack;
@@ -80,7 +83,7 @@ uint32_t create_thread(process_t *process, entry_t entry, void *args, uint32_t p
         }
     }
 
-    uint32_t *kstack = (uint32_t *)stack_top(thread->kstack);
+    uint32_t *kstack = (uint32_t *)kstack_top(thread->kstack);
     uint32_t data_segment = user ? 0x20+3 : 0x10;
     uint32_t code_segment = user ? 0x18+3 : 0x08;
 
@@ -115,37 +118,77 @@ uint32_t create_thread(process_t *process, entry_t entry, void *args, uint32_t p
     PUSH(kstack, data_segment);             /* ds */
     PUSH(kstack, data_segment);             /* es */
     PUSH(kstack, data_segment);             /* fs */
-    PUSH(kstack, data_segment);             /* gs */
+    PUSH(kstack, user ? data_segment : PERCPU_SEL); /* gs */
+
+    /* frame popped by switch_context the first time the thread runs */
+    PUSH(kstack, (uintptr_t)&thread_trampoline); /* return address */
+    PUSH(kstack, 0);                        /* ebp */
+    PUSH(kstack, 0);                        /* ebx */
+    PUSH(kstack, 0);                        /* esi */
+    PUSH(kstack, 0);                        /* edi */
 
     thread->esp = (uintptr_t)kstack;
     thread->ss = data_segment;
     thread->id = request_thread_id();
     thread->process = process;
     /* thread's priority can't exceed its parent's priority */
-    thread->priority = min(priority, process->priority); 
+    thread->priority = process ? min(priority, process->priority) : priority;
     thread->page_dir = process ? process->page_dir : kernel_directory;
     thread->runtime = 0;
 
-    irq_state_t irq_state = irq_save();
+    return thread;
+}
 
-    ++num_threads;
+uint32_t create_thread(process_t *process, entry_t entry, void *args, uint32_t priority, int user, int vm86)
+{
+    thread_t *thread = new_thread(process, entry, args, priority, user, vm86);
+    if (!thread) {
+        return 0;
+    }
+
+    __sync_add_and_fetch(&num_threads, 1);
+    tracepoint(thread, create, "%u process %u priority %u user %u", thread->id,
+               process ? process->id : 0, thread->priority, user);
 
     /* register this thread */
     schedule_thread(thread);
 
-    irq_restore(irq_state);
-
     return thread->id;
 }
 
+/* the idle thread is handed to the scheduler directly and never queued */
+thread_t *create_idle_thread(entry_t entry)
+{
+    return new_thread(0, entry, 0, 0, 0, 0);
+}
+
+/* the context an application processor booted on, it has no frame to
+ * start from since it is already running */
+thread_t *create_cpu_thread(uintptr_t kstack)
+{
+    thread_t *thread = (thread_t *)kmalloc(sizeof(thread_t));
+    if (!thread) {
+        return 0;
+    }
+    memset(thread, 0, sizeof(thread_t));
+
+    thread->id = request_thread_id();
+    thread->kstack = kstack;
+    thread->page_dir = kernel_directory;
+
+    return thread;
+}
+
 void destroy_thread(thread_t *thread)
 {
     if (!thread) {
         return;
     }
-    --num_threads;
+    __sync_sub_and_fetch(&num_threads, 1);
+
+    fpu_release(thread);
 
-    DBPRINT("\033\012%s Freeing kstack %x ", thread->ustack ? "User" : "Kernel", thread->kstack);
+    tracepoint(thread, destroy, "%u kstack %x ustack %x", thread->id, thread->kstack, thread->ustack);
     kfree((void *)thread->kstack);
 
     if (thread->ustack != 0) {
@@ -155,22 +198,25 @@ void destroy_thread(thread_t *thread)
         for (int i = -15; i < 15; ++i) {
             DBPRINT("%x -> stack[%d] = %x\n", thread->kstack + i, i, stack[i]);
         } */
-    
-        DBPRINT("- Freeing ustack %x ", thread->ustack);
+
         kfree((void *)thread->ustack);
     }
 
-    DBPRINT("- Freeing thread %x\033\017\n", thread);
     kfree(thread);
 }
 
 void thread_exit(void)
 {
+    thread_t *current = get_current_thread();
+
+    /* nobody may wake it once it is freed */
+    if (current->wait_on) {
+        wait_queue_remove(current->wait_on);
+    }
     irq_disable();
-    current_thread->state = TASK_FINISHED;
-    irq_enable();
+    current->state = TASK_FINISHED;
 
-    /* this call also enables IRQs */
-    switch_next();
+    /* the thread is reaped by the next one, this never returns */
+    thread_yield();
 }
 
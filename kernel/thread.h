@@ -2,9 +2,26 @@
 #define __KERNEL_THREAD_H__
 
 #include <process.h>
+#include <scheduler.h>
 #include <types.h>
 
+#define STACK_SIZE 0x2000   /* user and boot stacks */
+#define KSTACK_SIZE 0x1000  /* interrupts run on the CPU's own stack */
+#define stack_top(s) ((s) + STACK_SIZE)
+#define kstack_top(s) ((s) + KSTACK_SIZE)
+
 struct page_dir;
+struct cpu;
+
+typedef struct
+{
+    uint32_t nvcsw;         /* voluntary context switches */
+    uint32_t nivcsw;        /* involuntary context switches */
+    uint64_t wait_time;     /* cycles spent ready but not running */
+    uint64_t sleep_time;    /* cycles spent blocked */
+    uint64_t stamp;         /* cycles at the last state change */
+    uint32_t latency[SCHED_LAT_BUCKETS]; /* from ready to running */
+} thread_stats_t;
 
 typedef struct thread
 {
@@ -17,14 +34,25 @@ typedef struct thread
     uint32_t        id;
     int             state;
     uint32_t        priority;
+    uint32_t        timeslice; /* ticks left before preemption */
     uint64_t        runtime;      
-    struct thread   *next;
+    void            *fpu_state; /* FXSAVE area, allocated on first use */
+    thread_stats_t  stats;
+    struct cpu      *cpu;       /* whose run queue the thread is on */
+    volatile int    wake_pending; /* woken while it was still running */
+    struct wait_queue *wait_on; /* where it waits, if anywhere */
+    struct thread   *wait_next;
+    struct thread   *next;      /* run queue */
     struct thread   *prev;
+    struct thread   *all_next;  /* every thread */
+    struct thread   *all_prev;
 } thread_t;
 
 typedef void (*entry_t)();
 
 uint32_t create_thread(process_t *process, entry_t entry, void *args, uint32_t priority, int user, int vm86);
+thread_t *create_idle_thread(entry_t entry);
+thread_t *create_cpu_thread(uintptr_t kstack);
 void destroy_thread(thread_t *thread);
 void thread_exit(void);
 uint32_t get_num_threads(void);
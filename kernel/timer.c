@@ -0,0 +1,272 @@
+#include <system.h>
+#include <spinlock.h>
+#include <pit.h>
+#include <thread.h>
+#include <scheduler.h>
+#include <timer.h>
+#include <smp.h>
+#include <lapic.h>
+#include <vdso.h>
+
+/* Timers are hashed by expiry tick into a wheel of TIMER_WHEEL_SIZE slots.
+ * Each tick only the slot of that tick is looked at, timers more than a
+ * turn away stay in their slot until their round comes. The wheel is
+ * only run by the boot CPU which owns the clock, the other CPUs' local
+ * timers only tick to preempt their threads. */
+
+#define WHEEL_MASK      (TIMER_WHEEL_SIZE - 1)
+#define clock_cpu       (&cpus[0])
+
+static ktimer_t *wheel[TIMER_WHEEL_SIZE];
+static clock_event_t *clock = 0;
+static uint32_t timer_ticks = 0;    /* last tick processed */
+static uint32_t nohz_deadline = 0;  /* tick the one-shot expires at */
+static spinlock_t timer_lock = SPINLOCK_INIT("timer");
+
+static void timer_nohz_program(void);
+
+static void timer_unlink(ktimer_t *timer)
+{
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        wheel[timer->expires & WHEEL_MASK] = timer->next;
+    }
+    if (timer->next) {
+        timer->next->prev = timer->prev;
+    }
+    timer->pending = 0;
+}
+
+/* called with the lock held, it is dropped around the callbacks which
+ * may well add timers or wake threads */
+static void timer_run(uint32_t now)
+{
+    ktimer_t *timer;
+    timer_fn_t fn;
+
+    /* after a one-shot several ticks may have gone by */
+    while ((int32_t)(now - timer_ticks) > 0) {
+        ++timer_ticks;
+        timer = wheel[timer_ticks & WHEEL_MASK];
+        while (timer) {
+            if ((int32_t)(timer->expires - timer_ticks) > 0) {
+                timer = timer->next;
+                continue;
+            }
+            timer->running = 1;
+            timer_unlink(timer);
+            fn = timer->fn;
+
+            spin_unlock(&timer_lock);
+            fn(timer->data);
+            timer->running = 0;
+            spin_lock(&timer_lock);
+
+            /* the slot may have changed meanwhile */
+            timer = wheel[timer_ticks & WHEEL_MASK];
+        }
+    }
+}
+
+static void timer_handler(registers_t *regs)
+{
+    (void)regs;
+    if (this_cpu() != clock_cpu) {
+        return;
+    }
+
+    spin_lock(&timer_lock);
+    timer_run(clock->get_ticks());
+    vdso_update(timer_ticks, clock->cycles_per_tick);
+
+    /* the one-shot expired, ask for the next one */
+    if (clock_cpu->nohz) {
+        timer_nohz_program();
+    }
+    spin_unlock(&timer_lock);
+}
+
+/* another CPU added a timer that expires before the programmed one-shot */
+static void timer_kick(registers_t *regs)
+{
+    (void)regs;
+    spin_lock(&timer_lock);
+    if (clock_cpu->nohz) {
+        timer_nohz_program();
+    }
+    spin_unlock(&timer_lock);
+}
+
+void timer_init(void)
+{
+    spin_lock_register(&timer_lock);
+    timer_set_clock(&pit_clock);
+    attach_interrupt_handler(IPI_TIMER, timer_kick);
+}
+
+/* The new clock carries on with the tick count of the old one and starts
+ * periodic. Its handler is attached before ours so the tick count is up
+ * to date when the timers run. */
+void timer_set_clock(clock_event_t *new_clock)
+{
+    irq_state_t irq_state = spin_lock_irqsave(&timer_lock);
+
+    if (clock) {
+        detach_interrupt_handler(clock->vector, timer_handler);
+    }
+    clock = new_clock;
+    clock_cpu->nohz = 0;
+    clock->periodic();
+    timer_ticks = clock->get_ticks();
+    attach_interrupt_handler(clock->vector, timer_handler);
+
+    spin_unlock_irqrestore(&timer_lock, irq_state);
+
+    kprintf(INFO, "[timer] Ticking from the %s\n", clock->name);
+}
+
+uint32_t timer_get_ticks(void)
+{
+    return clock->get_ticks();
+}
+
+void timer_setup(ktimer_t *timer, timer_fn_t fn, void *data)
+{
+    timer->fn = fn;
+    timer->data = data;
+    timer->pending = 0;
+    timer->running = 0;
+    timer->next = timer->prev = 0;
+}
+
+void timer_add(ktimer_t *timer, uint32_t delay)
+{
+    irq_state_t irq_state = spin_lock_irqsave(&timer_lock);
+
+    if (timer->pending) {
+        timer_unlink(timer);
+    }
+    timer->expires = clock->get_ticks() + (delay ? delay : 1);
+
+    ktimer_t **slot = &wheel[timer->expires & WHEEL_MASK];
+    timer->prev = 0;
+    timer->next = *slot;
+    if (*slot) {
+        (*slot)->prev = timer;
+    }
+    *slot = timer;
+    timer->pending = 1;
+
+    if (clock_cpu->nohz && (int32_t)(timer->expires - nohz_deadline) < 0) {
+        if (this_cpu() == clock_cpu) {
+            timer_nohz_program();
+        } else {
+            smp_send_ipi(clock_cpu, IPI_TIMER);
+        }
+    }
+
+    spin_unlock_irqrestore(&timer_lock, irq_state);
+}
+
+void timer_del(ktimer_t *timer)
+{
+    irq_state_t irq_state = spin_lock_irqsave(&timer_lock);
+
+    if (timer->pending) {
+        timer_unlink(timer);
+    }
+
+    spin_unlock_irqrestore(&timer_lock, irq_state);
+}
+
+/* ticks until the first timer expires, at most max */
+static uint32_t timer_next_deadline(uint32_t now, uint32_t max)
+{
+    uint32_t delta;
+    ktimer_t *timer;
+
+    /* the current slot first, it holds the timers that are already due */
+    for (delta = 0; delta < max && delta < TIMER_WHEEL_SIZE; ++delta) {
+        for (timer = wheel[(now + delta) & WHEEL_MASK]; timer; timer = timer->next) {
+            if ((int32_t)(timer->expires - now) <= (int32_t)delta) {
+                return delta;
+            }
+        }
+    }
+    return min(max, TIMER_WHEEL_SIZE);
+}
+
+/* the lock must be held, on the clock CPU */
+static void timer_nohz_program(void)
+{
+    uint32_t now = clock->get_ticks();
+    uint32_t delta = clock->oneshot(timer_next_deadline(now, NOHZ_MAX_TICKS));
+    nohz_deadline = now + delta;
+}
+
+/* Stop the periodic tick of this CPU, the scheduler calls this when at
+ * most one thread can run there so nobody needs to be preempted. The
+ * clock then only fires for the next timer, the other CPUs' local timers
+ * simply stop. */
+void timer_nohz_enter(void)
+{
+#ifdef TIMER_NOHZ
+    cpu_t *cpu = this_cpu();
+
+    if (cpu->nohz) {
+        return;
+    }
+    if (cpu != clock_cpu) {
+        cpu->nohz = 1;
+        lapic_timer_stop();
+        return;
+    }
+    spin_lock(&timer_lock);
+    cpu->nohz = 1;
+    timer_nohz_program();
+    spin_unlock(&timer_lock);
+#endif
+}
+
+void timer_nohz_exit(void)
+{
+    cpu_t *cpu = this_cpu();
+
+    if (!cpu->nohz) {
+        return;
+    }
+    if (cpu != clock_cpu) {
+        cpu->nohz = 0;
+        lapic_timer_periodic();
+        return;
+    }
+    spin_lock(&timer_lock);
+    cpu->nohz = 0;
+    clock->periodic();
+    spin_unlock(&timer_lock);
+}
+
+static void sleep_timeout(void *data)
+{
+    wake_thread((thread_t *)data);
+}
+
+void thread_sleep(uint32_t ms)
+{
+    ktimer_t timer;
+
+    irq_state_t irq_state = irq_save();
+
+    timer_setup(&timer, sleep_timeout, get_current_thread());
+    timer_add(&timer, ms_to_ticks(ms));
+
+    /* we may be woken for another reason, the timer lives on our stack */
+    while (timer.pending) {
+        block_thread();
+    }
+    /* another CPU may still be in the callback */
+    while (timer.running) ;
+
+    irq_restore(irq_state);
+}
@@ -0,0 +1,48 @@
+#ifndef __KERNEL_TIMER_H__
+#define __KERNEL_TIMER_H__
+
+#include <types.h>
+
+#define TIMER_WHEEL_SIZE    256     /* must be a power of 2 */
+#define NOHZ_MAX_TICKS      1000    /* longest one-shot we ask for */
+
+#define ms_to_ticks(ms)     ((ms) * TIMER_FREQ / 1000)
+
+typedef void (*timer_fn_t)(void *data);
+
+/* the device behind the tick, the PIT or the local APIC timer. Only the
+ * boot CPU counts ticks and runs the timers. */
+typedef struct clock_event
+{
+    const char *name;
+    uint8_t    vector;                      /* interrupt it raises */
+    uint32_t   cycles_per_tick;             /* TSC cycles, 0 if unknown */
+    uint32_t   (*get_ticks)(void);
+    uint32_t   (*oneshot)(uint32_t nticks); /* returns the ticks programmed */
+    void       (*periodic)(void);
+} clock_event_t;
+
+typedef struct ktimer
+{
+    uint32_t      expires;  /* tick at which the timer fires */
+    timer_fn_t    fn;       /* called from the timer IRQ */
+    void          *data;
+    int           pending;
+    volatile int  running;  /* the callback is being called */
+    struct ktimer *next;
+    struct ktimer *prev;
+} ktimer_t;
+
+void timer_init(void);
+void timer_set_clock(clock_event_t *clock);
+uint32_t timer_get_ticks(void);
+void timer_setup(ktimer_t *timer, timer_fn_t fn, void *data);
+void timer_add(ktimer_t *timer, uint32_t delay);
+void timer_del(ktimer_t *timer);
+
+void timer_nohz_enter(void);
+void timer_nohz_exit(void);
+
+void thread_sleep(uint32_t ms);
+
+#endif
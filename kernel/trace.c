@@ -0,0 +1,104 @@
+#include <system.h>
+#include <vsprintf.h>
+#include <smp.h>
+#include <trace.h>
+
+/* Each CPU records into its own ring, the oldest events are overwritten.
+ * A slot is claimed with an atomic increment so an interrupt tracing in
+ * the middle of an event gets the next one. The dump merges the rings in
+ * TSC order. In raw form every event is printed as hexadecimal words,
+ * the format address is then looked up in kernel.elf on the host:
+ *     cpu tsc fmt a0 a1 a2 a3 */
+
+volatile int trace_enabled = 0;
+static trace_buf_t trace_bufs[MAX_CPUS];
+
+void trace_init(void)
+{
+    trace_enabled = 1;
+    kprintf(INFO, "[trace] %u events per CPU\n", TRACE_ENTRIES);
+}
+
+void trace_event(const char *fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    trace_buf_t *buf = &trace_bufs[this_cpu()->id];
+    uint32_t idx = __sync_fetch_and_add(&buf->head, 1);
+    trace_entry_t *entry = &buf->entries[idx & (TRACE_ENTRIES - 1)];
+
+    entry->tsc = get_cycles_count();
+    entry->fmt = fmt;
+    entry->args[0] = a0;
+    entry->args[1] = a1;
+    entry->args[2] = a2;
+    entry->args[3] = a3;
+}
+
+/* every line is written out before the next, with interrupts disabled it
+ * doesn't go through the log ring which would overflow */
+static void trace_print(const char *fmt, ...)
+{
+    char buf[256];
+    va_list args;
+
+    va_start(args, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, args);
+    va_end(args);
+
+    irq_state_t irq_state = irq_save();
+    kprintf(DEBUG, "%s", buf);
+    irq_restore(irq_state);
+}
+
+void trace_dump(int raw)
+{
+    uint32_t pos[MAX_CPUS], end[MAX_CPUS];
+    uint32_t cpu, next;
+    uint64_t start = 0;
+    trace_entry_t *entry, *first;
+    char msg[128];
+    int was_enabled = trace_enabled;
+
+    trace_enabled = 0;
+
+    for (cpu = 0; cpu < num_cpus; ++cpu) {
+        end[cpu] = trace_bufs[cpu].head;
+        pos[cpu] = end[cpu] > TRACE_ENTRIES ? end[cpu] - TRACE_ENTRIES : 0;
+    }
+
+    for (;;) {
+        /* the oldest event left among the CPUs */
+        first = 0;
+        next = 0;
+        for (cpu = 0; cpu < num_cpus; ++cpu) {
+            if (pos[cpu] == end[cpu]) {
+                continue;
+            }
+            entry = &trace_bufs[cpu].entries[pos[cpu] & (TRACE_ENTRIES - 1)];
+            if (!first || entry->tsc < first->tsc) {
+                first = entry;
+                next = cpu;
+            }
+        }
+        if (!first) {
+            break;
+        }
+        ++pos[next];
+        if (!start) {
+            start = first->tsc;
+        }
+
+        if (raw) {
+            trace_print("%x %x%08x %x %x %x %x %x\n", next,
+                        (uint32_t)(first->tsc >> 32), (uint32_t)first->tsc,
+                        (uint32_t)first->fmt, first->args[0], first->args[1],
+                        first->args[2], first->args[3]);
+        } else {
+            snprintf(msg, sizeof(msg), first->fmt, first->args[0],
+                     first->args[1], first->args[2], first->args[3]);
+            trace_print("[trace] %u %10u Kc %s\n", next,
+                        (uint32_t)((first->tsc - start) >> 10), msg);
+        }
+    }
+
+    trace_enabled = was_enabled;
+}
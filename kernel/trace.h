@@ -0,0 +1,46 @@
+#ifndef __KERNEL_TRACE_H__
+#define __KERNEL_TRACE_H__
+
+#include <types.h>
+
+#define TRACE                   /* compile the trace points in */
+#define TRACE_ENTRIES   1024    /* per CPU, must be a power of 2 */
+#define TRACE_ARGS      4
+
+/* An event only records where its format string is, the TSC and the raw
+ * arguments. It is formatted when the buffer is dumped, so the strings
+ * given with %s must still be around by then. */
+typedef struct
+{
+    uint64_t   tsc;
+    const char *fmt;
+    uint32_t   args[TRACE_ARGS];
+    uint32_t   pad;
+} trace_entry_t;
+
+typedef struct
+{
+    volatile uint32_t head;     /* entries written so far */
+    trace_entry_t     entries[TRACE_ENTRIES];
+} trace_buf_t;
+
+extern volatile int trace_enabled;
+
+void trace_init(void);
+void trace_event(const char *fmt, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3);
+void trace_dump(int raw);
+
+/* trace(fmt, up to 4 integer arguments) */
+#ifdef TRACE
+#define trace(...)  TRACE_EVENT(__VA_ARGS__, 0, 0, 0, 0, 0)
+#define TRACE_EVENT(fmt, a0, a1, a2, a3, ...) \
+    do { \
+        if (trace_enabled) { \
+            trace_event(fmt, (uint32_t)(a0), (uint32_t)(a1), (uint32_t)(a2), (uint32_t)(a3)); \
+        } \
+    } while (0)
+#else
+#define trace(...)  do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,156 @@
+#include <system.h>
+#include <spinlock.h>
+#include <string.h>
+#include <smp.h>
+#include <tracepoint.h>
+
+/* The kernel code is patched in place, the supervisor may write to it
+ * since CR0.WP is clear. A site is replaced by one 8 bytes compare and
+ * exchange, the other CPUs are then sent an interrupt whose iret
+ * serializes them before they may run the new code. The patching waits
+ * until each of them took it. */
+
+extern jump_entry_t __start___jump_table[];
+extern jump_entry_t __stop___jump_table[];
+extern tracepoint_t __start___tracepoints[];
+extern tracepoint_t __stop___tracepoints[];
+
+static const uint8_t nop5[] = { 0x0f, 0x1f, 0x44, 0x00, 0x00 };
+
+static spinlock_t patch_lock = SPINLOCK_INIT("tracepoint");
+
+static void patch_site(jump_entry_t *entry, int on)
+{
+    volatile uint64_t *site = (volatile uint64_t *)entry->code;
+    uint64_t old, new;
+    uint8_t *code = (uint8_t *)&new;
+    int32_t rel = entry->target - (entry->code + 5);
+
+    do {
+        old = *site;
+        new = old;
+        if (on) {
+            code[0] = 0xe9;     /* jmp rel32 */
+            memcpy(&code[1], &rel, 4);
+        } else {
+            memcpy(code, nop5, 5);
+        }
+    } while (!__sync_bool_compare_and_swap(site, old, new));
+}
+
+/* called with interrupts enabled, another CPU may be waiting for ours */
+static void sync_cpus(void)
+{
+    uint32_t seen[MAX_CPUS];
+    uint32_t i;
+
+    for (i = 0; i < num_cpus; ++i) {
+        if (&cpus[i] != this_cpu() && cpus[i].started) {
+            seen[i] = cpus[i].nr_resched;
+            smp_send_ipi(&cpus[i], IPI_RESCHED);
+        }
+    }
+    for (i = 0; i < num_cpus; ++i) {
+        if (&cpus[i] != this_cpu() && cpus[i].started) {
+            while (cpus[i].nr_resched == seen[i]) {
+                asm volatile ("pause" ::: "memory");
+            }
+        }
+    }
+}
+
+static int tracepoint_match(tracepoint_t *tp, const char *subsys, const char *name)
+{
+    if (strcmp(subsys, "all") == 0) {
+        return 1;
+    }
+    return strcmp(tp->subsys, subsys) == 0 && (!name || strcmp(tp->name, name) == 0);
+}
+
+/* name may be 0 for every tracepoint of the subsystem, returns how many
+ * were found */
+int tracepoint_enable(const char *subsys, const char *name, int on)
+{
+    tracepoint_t *tp;
+    jump_entry_t *entry;
+    int found = 0;
+
+    irq_state_t irq_state = spin_lock_irqsave(&patch_lock);
+
+    for (tp = __start___tracepoints; tp < __stop___tracepoints; ++tp) {
+        if (tracepoint_match(tp, subsys, name)) {
+            tp->enabled = on;
+            ++found;
+        }
+    }
+    for (entry = __start___jump_table; entry < __stop___jump_table; ++entry) {
+        if (tracepoint_match(entry->tp, subsys, name)) {
+            patch_site(entry, on);
+        }
+    }
+
+    spin_unlock_irqrestore(&patch_lock, irq_state);
+
+    if (found) {
+        sync_cpus();
+    }
+    return found;
+}
+
+/* A list of subsys or subsys:name separated by commas, the ones preceded
+ * by a minus are turned off, e.g. "sched,mem:expand,-paging". It is given
+ * as trace= on the kernel command line. */
+void tracepoint_command(const char *cmd)
+{
+    char subsys[32], *name;
+    size_t len;
+    int on;
+
+    while (*cmd && *cmd != ' ') {
+        on = *cmd != '-';
+        if (!on) {
+            ++cmd;
+        }
+        for (len = 0; cmd[len] && cmd[len] != ',' && cmd[len] != ' '; ++len)
+            ;
+        if (len > 0 && len < sizeof(subsys)) {
+            memcpy(subsys, cmd, len);
+            subsys[len] = '\0';
+            for (name = subsys; *name && *name != ':'; ++name)
+                ;
+            if (*name) {
+                *name++ = '\0';
+            } else {
+                name = 0;
+            }
+            if (!tracepoint_enable(subsys, name, on)) {
+                kprintf(WARNING, "[trace] No tracepoint %s\n", subsys);
+            }
+        }
+        cmd += len;
+        if (*cmd == ',') {
+            ++cmd;
+        }
+    }
+}
+
+void tracepoint_init(const char *cmdline)
+{
+    spin_lock_register(&patch_lock);
+
+    for (; cmdline && *cmdline; ++cmdline) {
+        if (strncmp(cmdline, "trace=", 6) == 0) {
+            tracepoint_command(cmdline + 6);
+            break;
+        }
+    }
+}
+
+void tracepoint_list(void)
+{
+    tracepoint_t *tp;
+
+    for (tp = __start___tracepoints; tp < __stop___tracepoints; ++tp) {
+        kprintf(INFO, "[trace] %s:%s %s\n", tp->subsys, tp->name, tp->enabled ? "on" : "off");
+    }
+}
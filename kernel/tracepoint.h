@@ -0,0 +1,70 @@
+#ifndef __KERNEL_TRACEPOINT_H__
+#define __KERNEL_TRACEPOINT_H__
+
+#include <types.h>
+#include <system.h>
+#include <trace.h>
+
+/* A tracepoint site is a 5 bytes NOP while it is off, so it costs no
+ * test nor memory load. Turning it on patches the NOP into a jump to the
+ * code recording the event in the trace buffer. Every site is listed in
+ * the __jump_table section, the tracepoints themselves in __tracepoints
+ * so they can be looked up by name. */
+
+typedef struct tracepoint
+{
+    const char   *subsys;
+    const char   *name;
+    volatile int enabled;
+} tracepoint_t;
+
+typedef struct
+{
+    uintptr_t    code;      /* the NOP */
+    uintptr_t    target;    /* where the jump goes */
+    tracepoint_t *tp;
+} jump_entry_t;
+
+#define TP_NAME(sub, name)  __tracepoint_##sub##_##name
+
+#define DEFINE_TRACEPOINT(sub, name) \
+    tracepoint_t TP_NAME(sub, name) \
+        __attribute__((section("__tracepoints"), used, aligned(4))) = { #sub, #name, 0 }
+
+#define DECLARE_TRACEPOINT(sub, name) \
+    extern tracepoint_t TP_NAME(sub, name)
+
+#define TP_STR(x)           #x
+#define TP_XSTR(x)          TP_STR(x)
+#define TP_CAT(a, b)        a##b
+#define TP_LABEL(line)      TP_CAT(tp_on_, line)
+
+/* tracepoint(subsystem, name, fmt, up to 4 integer arguments). The NOP
+ * is 8 bytes aligned so it is patched with a single write, the
+ * tracepoint is named in the asm since its address isn't an immediate
+ * in position independent code. Labels are made unique by the line. */
+#define tracepoint(sub, name, ...) \
+    do { \
+        asm goto (".balign 8                                 \n" \
+                  "1: .byte 0x0f, 0x1f, 0x44, 0x00, 0x00     \n" \
+                  ".pushsection __jump_table, \"aw\"         \n" \
+                  ".long 1b, %l0, " TP_XSTR(TP_NAME(sub, name)) "\n" \
+                  ".popsection                               \n" \
+                  :::: TP_LABEL(__LINE__)); \
+        break; \
+    TP_LABEL(__LINE__): \
+        TP_EVENT(#sub "." #name ": ", __VA_ARGS__, 0, 0, 0, 0, 0); \
+    } while (0)
+
+/* the buffer is off while it is dumped */
+#define TP_EVENT(prefix, fmt, a0, a1, a2, a3, ...) \
+    if (trace_enabled) { \
+        trace_event(prefix fmt, (uint32_t)(a0), (uint32_t)(a1), (uint32_t)(a2), (uint32_t)(a3)); \
+    }
+
+void tracepoint_init(const char *cmdline);
+int tracepoint_enable(const char *subsys, const char *name, int on);
+void tracepoint_command(const char *cmd);
+void tracepoint_list(void);
+
+#endif
@@ -0,0 +1,69 @@
+#include <system.h>
+#include <kheap.h>
+#include <paging.h>
+#include <string.h>
+#include <process.h>
+#include <thread.h>
+#include <smp.h>
+#include <vdso.h>
+
+/* one page for all the processes, mapped read only in each of them */
+
+vdso_data_t *vdso_data = 0;
+static uintptr_t vdso_phys;
+
+void vdso_init(void)
+{
+    vdso_data = (vdso_data_t *)kmalloc_ap(FRAME_SIZE, &vdso_phys);
+    assert(vdso_data != 0);
+    memset(vdso_data, 0, FRAME_SIZE);
+    vdso_data->tick_freq = TIMER_FREQ;
+    vdso_data->num_cpus = 1;
+    vdso_data->cpu_features = cpu_features;
+
+    kprintf(INFO, "[vdso] Kernel data page at %x\n", VDSO_USER_ADDR);
+}
+
+void vdso_map(struct page_dir *dir)
+{
+    pte_t *page;
+
+    if (!vdso_data) {
+        return;
+    }
+    page = get_page(VDSO_USER_ADDR, 1, dir);
+    map_page(page, 0, 0, vdso_phys);
+}
+
+/* called by the boot CPU on each tick */
+void vdso_update(uint32_t ticks, uint32_t cycles_per_tick)
+{
+    if (!vdso_data) {
+        return;
+    }
+    ++vdso_data->seq;
+    vdso_barrier();
+    vdso_data->ticks = ticks;
+    vdso_data->tick_stamp = get_cycles_count();
+    vdso_data->cycles_per_tick = cycles_per_tick;
+    vdso_data->num_cpus = num_cpus;
+    vdso_barrier();
+    ++vdso_data->seq;
+}
+
+/* called by the scheduler of each CPU with the thread it switches to */
+void vdso_set_current(thread_t *thread)
+{
+    vdso_cpu_t *slot;
+
+    if (!vdso_data) {
+        return;
+    }
+    slot = &vdso_data->cpu[this_cpu()->id];
+    ++slot->seq;
+    vdso_barrier();
+    slot->thread_id = thread->id;
+    slot->process_id = thread->process ? thread->process->id : 0;
+    vdso_barrier();
+    ++slot->seq;
+}
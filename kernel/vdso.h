@@ -0,0 +1,134 @@
+#ifndef __KERNEL_VDSO_H__
+#define __KERNEL_VDSO_H__
+
+#include <types.h>
+#include <system.h>
+#include <gdt.h>
+#include <smp.h>
+#include <cpufeature.h>
+
+/* A page the kernel keeps up to date and every process can read, so the
+ * time and the caller's identity are known without a system call. The
+ * clock is written by the boot CPU on each tick, the identity of the
+ * running thread by each CPU when it switches. Readers retry while the
+ * sequence count is odd or changed under them. */
+
+#define VDSO_USER_ADDR      0xbffff000  /* where the page is in every process */
+
+typedef struct
+{
+    volatile uint32_t seq;          /* bumped twice on every switch */
+    volatile uint32_t thread_id;
+    volatile uint32_t process_id;
+    uint32_t          pad;
+} vdso_cpu_t;
+
+typedef struct
+{
+    volatile uint32_t seq;          /* odd while the clock is updated */
+    volatile uint32_t ticks;
+    volatile uint64_t tick_stamp;   /* TSC at that tick */
+    uint32_t          cycles_per_tick; /* 0 if the TSC isn't calibrated */
+    uint32_t          tick_freq;
+    uint32_t          num_cpus;
+    uint32_t          cpu_features; /* for the library's cpu_features */
+    uint32_t          reserved[8];
+    vdso_cpu_t        cpu[MAX_CPUS];
+} vdso_data_t;
+
+struct thread;
+struct page_dir;
+
+extern vdso_data_t *vdso_data;
+
+void vdso_init(void);
+void vdso_map(struct page_dir *dir);
+void vdso_update(uint32_t ticks, uint32_t cycles_per_tick);
+void vdso_set_current(struct thread *thread);
+
+/* Helpers for the processes */
+
+#define vdso_page()     ((const vdso_data_t *)VDSO_USER_ADDR)
+
+inline static void vdso_barrier(void)
+{
+    asm volatile ("" ::: "memory");
+}
+
+/* the limit of the segment is the number of the CPU */
+inline static uint32_t vdso_getcpu(void)
+{
+    uint32_t id;
+    asm volatile ("lsl %1, %0" : "=r"(id) : "r"((uint32_t)CPUNR_SEL));
+    return id;
+}
+
+/* the count of the last tick plus the ticks the TSC went through since,
+ * the boot CPU doesn't tick while it is idle */
+inline static uint32_t vdso_get_ticks(void)
+{
+    const vdso_data_t *vdso = vdso_page();
+    uint32_t seq, ticks, cycles_per_tick;
+    uint64_t stamp, now;
+
+    do {
+        seq = vdso->seq;
+        vdso_barrier();
+        ticks = vdso->ticks;
+        stamp = vdso->tick_stamp;
+        cycles_per_tick = vdso->cycles_per_tick;
+        vdso_barrier();
+    } while ((seq & 1) || seq != vdso->seq);
+
+    if (cycles_per_tick) {
+        asm volatile ("rdtsc" : "=A"(now));
+        if (now > stamp && now - stamp < 0xffffffff) {
+            ticks += (uint32_t)(now - stamp) / cycles_per_tick;
+        }
+    }
+    return ticks;
+}
+
+/* the slot of the CPU only describes us if no switch happened while it
+ * was read and we were still on that CPU afterwards */
+inline static void vdso_self(uint32_t *thread_id, uint32_t *process_id)
+{
+    const vdso_data_t *vdso = vdso_page();
+    const vdso_cpu_t *slot;
+    uint32_t cpu, seq;
+
+    for (;;) {
+        cpu = vdso_getcpu();
+        slot = &vdso->cpu[cpu];
+        seq = slot->seq;
+        vdso_barrier();
+        *thread_id = slot->thread_id;
+        *process_id = slot->process_id;
+        vdso_barrier();
+        if (!(seq & 1) && seq == slot->seq && vdso_getcpu() == cpu) {
+            return;
+        }
+    }
+}
+
+/* what a process sets the library's cpu_features to */
+inline static uint32_t vdso_cpu_features(void)
+{
+    return vdso_page()->cpu_features;
+}
+
+inline static uint32_t vdso_gettid(void)
+{
+    uint32_t tid, pid;
+    vdso_self(&tid, &pid);
+    return tid;
+}
+
+inline static uint32_t vdso_getpid(void)
+{
+    uint32_t tid, pid;
+    vdso_self(&tid, &pid);
+    return pid;
+}
+
+#endif
@@ -3,21 +3,41 @@
 #include <utils.h>
 #include <vga.h>
 #include <driver.h>
+#include <spinlock.h>
 
 #define CURS_CTRL       0x3d4
 #define CURS_DATA       0x3d5
 #define HIGH_BYTE       14
 #define LOW_BYTE        15
 
+/* Characters go to a shadow of the screen whose lines are used as a ring,
+ * scrolling only moves the first line and clears the new last one. The
+ * lines changed are copied to the video memory and the cursor is moved
+ * once per call, not per character. */
+
+#define ALL_LINES       ((1 << ROWS) - 1)
+#define line(y)         (shadow + ((top + (y)) % ROWS) * COLS)
+
 static uint16_t xpos = 0, ypos = 0;
 static uint16_t *video_mem = (uint16_t *)0xc00b8000;
 static uint16_t attribute = 0x0f00;
 static device_t vga_device;
 
+static uint16_t shadow[ROWS * COLS];
+static uint16_t top = 0;                /* shadow line shown first */
+static uint32_t dirty = 0;              /* lines to copy, one bit each */
+static uint16_t cursor = 0xffff;        /* where the hardware cursor is */
+static spinlock_t vga_lock = SPINLOCK_INIT("vga");
+static device_t *redirect = 0;
+
+static void put_char(const char c);
+static void flush(void);
+
 device_t *vga_init()
 {
         get_cursor_pos(&xpos, &ypos);
         vga_clear();
+        spin_lock_register(&vga_lock);
 
         vga_device.read = 0;
         vga_device.write = vga_write;
@@ -25,17 +45,57 @@ device_t *vga_init()
         return &vga_device;
 }
 
+/* the text screen isn't shown once the framebuffer console is up, what
+ * is printed here goes there instead */
+void vga_redirect(device_t *dev)
+{
+        redirect = dev;
+}
+
 void vga_clear()
 {
-        uint16_t i;
-        for (i = 0; i < COLS * ROWS; ++i) {
-                video_mem[i] = (uint8_t)' ' | attribute;
-        }
+        irq_state_t irq_state = spin_lock_irqsave(&vga_lock);
+
+        memsetw(shadow, (uint8_t)' ' | attribute, COLS * ROWS);
+        top = 0;
+        dirty = ALL_LINES;
         xpos = ypos = 0;
-        set_cursor_pos(0, 0);
+        flush();
+
+        spin_unlock_irqrestore(&vga_lock, irq_state);
+}
+
+/* copy the lines changed and move the cursor, with the lock held */
+static void flush(void)
+{
+        uint16_t y, pos;
+
+        for (y = 0; dirty; ++y, dirty >>= 1) {
+                if (dirty & 1) {
+                        memcpy(video_mem + y * COLS, line(y), COLS * 2);
+                }
+        }
+
+        pos = ypos * COLS + xpos;
+        if (pos != cursor) {
+                set_cursor_pos(xpos, ypos);
+        }
 }
 
 void vga_print_char(const char c)
+{
+        if (redirect) {
+                redirect->write((uint8_t *)&c, 1);
+                return;
+        }
+
+        irq_state_t irq_state = spin_lock_irqsave(&vga_lock);
+        put_char(c);
+        flush();
+        spin_unlock_irqrestore(&vga_lock, irq_state);
+}
+
+static void put_char(const char c)
 {
         /* backspace */
         if (c == '\b') {
@@ -63,8 +123,8 @@ void vga_print_char(const char c)
         /* any character greater than and including a space is
          * a printable character */
         else if (c >= ' ') {
-                uint16_t *pos = video_mem + (ypos * COLS + xpos);
-                *pos = (uint16_t)c | attribute;
+                line(ypos)[xpos] = (uint16_t)c | attribute;
+                dirty |= 1 << ypos;
                 ++xpos;
         }
 
@@ -74,34 +134,32 @@ void vga_print_char(const char c)
         }
 
         vga_scroll();
-        set_cursor_pos(xpos, ypos);
 }
 
 void vga_print_dec(const uint32_t value)
 {
-        int i = 0;
         char buffer[12];
 
         itoa(value, buffer, 10);
-        while (buffer[i]) {
-                vga_print_char(buffer[i++]);
-        }
+        vga_print_str(buffer);
 }
 
 void vga_print_hex(const uint32_t value)
 {
-        int i = 0;
         char buffer[12];
 
         itoa(value, buffer + 0, 16);
-        while (buffer[i]) {
-                vga_print_char(buffer[i++]);
-        }
+        vga_print_str(buffer);
 }
 
 size_t vga_write(uint8_t *data, size_t len)
 {
+        if (redirect) {
+                return redirect->write(data, len);
+        }
+
         size_t i;
+        irq_state_t irq_state = spin_lock_irqsave(&vga_lock);
 
         for (i = 0; *data && i < len; ++data, ++i) {
                 if (*data == '\033') {
@@ -109,23 +167,36 @@ size_t vga_write(uint8_t *data, size_t len)
                         ++i;
                         vga_set_attribute(*data << 8 | (attribute & 0xf000));
                 } else {
-                        vga_print_char((const char)*data);
+                        put_char((const char)*data);
                 }
         }
+        flush();
+
+        spin_unlock_irqrestore(&vga_lock, irq_state);
         return i;
 }
 
 void vga_print_str(const char *str)
 {
+        if (redirect) {
+                redirect->write((uint8_t *)str, strlen(str));
+                return;
+        }
+
+        irq_state_t irq_state = spin_lock_irqsave(&vga_lock);
+
         while (*str) {
                 /* detect color attributes like \033\007 */
                 if (*str == '\033') {
                         vga_set_attribute(*++str << 8 | (attribute & 0xf000));
                         ++str;
                 } else {
-                        vga_print_char(*str++);
+                        put_char(*str++);
                 }
         }
+        flush();
+
+        spin_unlock_irqrestore(&vga_lock, irq_state);
 }
 
 void vga_set_attribute(const uint16_t attr)
@@ -135,17 +206,14 @@ void vga_set_attribute(const uint16_t attr)
 
 void vga_scroll()
 {
-        uint16_t blank, temp;
-
-        if (ypos >= ROWS) {
-                /* move the current text chunk back in the buffer by a line */
-                temp = ypos - ROWS + 1; /* points to the start of the chunk to be moved */
-                memcpy(video_mem, video_mem + temp * COLS, (ROWS - temp) * COLS * 2);
-
-                /* finally, clear the last line */
-                blank = (uint8_t)' ' | attribute;
-                memsetw(video_mem + (ROWS - temp) * COLS, blank, COLS);
-                ypos = ROWS - 1;
+        uint16_t blank = (uint8_t)' ' | attribute;
+
+        /* the first line becomes the last one, blank */
+        while (ypos >= ROWS) {
+                top = (top + 1) % ROWS;
+                memsetw(line(ROWS - 1), blank, COLS);
+                dirty = ALL_LINES;
+                --ypos;
         }
 }
 
@@ -167,6 +235,7 @@ void set_cursor_pos(uint16_t x, uint16_t y)
 {
         uint16_t pos = y * COLS + x;
 
+        cursor = pos;
         outb(CURS_CTRL, HIGH_BYTE);
         outb(CURS_DATA, pos >> 8);
 
@@ -9,6 +9,7 @@
 
 device_t *vga_init();
 size_t vga_write(uint8_t *data, size_t len);
+void vga_redirect(device_t *dev);
 
 void vga_clear();
 void vga_scroll();
@@ -0,0 +1,107 @@
+#include <system.h>
+#include <spinlock.h>
+#include <kheap.h>
+#include <thread.h>
+#include <scheduler.h>
+#include <workqueue.h>
+
+workqueue_t *system_wq = 0;
+
+static void worker(workqueue_t *wq)
+{
+    work_t *work;
+    work_fn_t fn;
+    void *data;
+    irq_state_t irq_state;
+
+    irq_state = spin_lock_irqsave(&wq->lock);
+    wq->worker = get_current_thread();
+    spin_unlock_irqrestore(&wq->lock, irq_state);
+
+    for (;;) {
+        irq_state = spin_lock_irqsave(&wq->lock);
+        work = wq->head;
+        if (!work) {
+            spin_unlock_irqrestore(&wq->lock, irq_state);
+            /* a wake-up between the unlock and here isn't lost */
+            block_thread();
+            continue;
+        }
+        wq->head = work->next;
+        if (!wq->head) {
+            wq->tail = 0;
+        }
+        fn = work->fn;
+        data = work->data;
+        work->pending = 0;  /* may be queued again from now on */
+        spin_unlock_irqrestore(&wq->lock, irq_state);
+
+        fn(data);
+    }
+}
+
+workqueue_t *workqueue_create(const char *name)
+{
+    workqueue_t *wq = (workqueue_t *)kmalloc(sizeof(workqueue_t));
+    if (!wq) {
+        return 0;
+    }
+    wq->name = name;
+    spin_lock_init(&wq->lock, name);
+    wq->head = wq->tail = 0;
+    wq->worker = 0;
+
+    if (!create_thread(0, (entry_t)worker, wq, WORKER_PRIORITY, 0, 0)) {
+        kfree(wq);
+        return 0;
+    }
+    return wq;
+}
+
+void workqueue_init(void)
+{
+    system_wq = workqueue_create("events");
+    assert(system_wq != 0);
+    kprintf(INFO, "[workqueue] Kernel worker started\n");
+}
+
+void work_init(work_t *work, work_fn_t fn, void *data)
+{
+    work->fn = fn;
+    work->data = data;
+    work->pending = 0;
+    work->next = 0;
+}
+
+/* returns 0 if the work was already queued, it then runs only once */
+int queue_work(workqueue_t *wq, work_t *work)
+{
+    struct thread *worker;
+    irq_state_t irq_state = spin_lock_irqsave(&wq->lock);
+
+    if (work->pending) {
+        spin_unlock_irqrestore(&wq->lock, irq_state);
+        return 0;
+    }
+    work->pending = 1;
+    work->next = 0;
+    if (wq->tail) {
+        wq->tail->next = work;
+    } else {
+        wq->head = work;
+    }
+    wq->tail = work;
+    worker = wq->worker;
+
+    spin_unlock_irqrestore(&wq->lock, irq_state);
+
+    if (worker) {
+        wake_thread(worker);
+    }
+    return 1;
+}
+
+int schedule_work(work_t *work)
+{
+    return queue_work(system_wq, work);
+}
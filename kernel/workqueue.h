@@ -0,0 +1,39 @@
+#ifndef __KERNEL_WORKQUEUE_H__
+#define __KERNEL_WORKQUEUE_H__
+
+#include <types.h>
+#include <spinlock.h>
+
+#define WORKER_PRIORITY     2
+
+struct thread;
+
+typedef void (*work_fn_t)(void *data);
+
+typedef struct work
+{
+    work_fn_t    fn;
+    void         *data;
+    volatile int pending;   /* queued and not started yet */
+    struct work  *next;
+} work_t;
+
+/* work items run in order by a kernel thread, they may sleep */
+typedef struct workqueue
+{
+    const char    *name;
+    spinlock_t    lock;
+    work_t        *head;
+    work_t        *tail;
+    struct thread *worker;
+} workqueue_t;
+
+extern workqueue_t *system_wq;
+
+void workqueue_init(void);
+workqueue_t *workqueue_create(const char *name);
+void work_init(work_t *work, work_fn_t fn, void *data);
+int queue_work(workqueue_t *wq, work_t *work);
+int schedule_work(work_t *work);
+
+#endif
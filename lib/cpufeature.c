@@ -0,0 +1,6 @@
+#include <cpufeature.h>
+
+/* None until told otherwise, the routines then take the paths any CPU
+ * has. The kernel fills it at boot, a user program sets it to
+ * vdso_cpu_features() before calling the library. */
+uint32_t cpu_features = 0;
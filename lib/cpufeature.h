@@ -0,0 +1,25 @@
+#ifndef __LIB_CPUFEATURE_H__
+#define __LIB_CPUFEATURE_H__
+
+#include <types.h>
+
+/* What the boot CPU reports, the others are taken to be the same. The
+ * kernel fills cpu_features from CPUID, a user program copies it from the
+ * vDSO page before calling the library. */
+#define CPU_FPU         (1 << 0)
+#define CPU_PSE         (1 << 1)    /* 4MB pages */
+#define CPU_TSC         (1 << 2)
+#define CPU_APIC        (1 << 3)
+#define CPU_SEP         (1 << 4)    /* SYSENTER/SYSEXIT */
+#define CPU_PGE         (1 << 5)    /* global pages */
+#define CPU_PAT         (1 << 6)
+#define CPU_FXSR        (1 << 7)
+#define CPU_SSE         (1 << 8)
+#define CPU_SSE2        (1 << 9)
+#define CPU_ERMSB       (1 << 10)   /* fast REP MOVSB/STOSB */
+
+extern uint32_t cpu_features;
+
+#define cpu_has(f)      ((cpu_features & (f)) != 0)
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __LIB_STDARG_H__
+#define __LIB_STDARG_H__
+
+/* the compiler knows where the arguments are, on the stack or in
+ * registers, the library is built for the host as well */
+typedef __builtin_va_list va_list;
+
+/* initialize AP so that it points to the first argument (right after LASTARG) */
+#define va_start(AP, LASTARG)  __builtin_va_start(AP, LASTARG)
+
+#define va_end(AP)  __builtin_va_end(AP)
+
+/* return the next argument in the argument list and increment AP */
+#define va_arg(AP, TYPE)  __builtin_va_arg(AP, TYPE)
+
+#define va_copy(DST, SRC)  __builtin_va_copy(DST, SRC)
+
+#endif
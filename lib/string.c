@@ -0,0 +1,245 @@
+#include <string.h>
+#include <cpufeature.h>
+
+/* Copies of 16 bytes or more align the destination and go a word at a
+ * time, unless the CPU has fast strings (ERMSB): REP MOVSB/STOSB then do
+ * the alignment themselves and beat the word loop at every size. The
+ * SSE registers aren't used, they belong to the thread owning the FPU. */
+
+#define SMALL_COPY  16
+
+static inline void copy_forward(void *dst, const void *src, size_t n)
+{
+    size_t head, words;
+
+    __asm__ volatile ("cld");
+    if (n >= SMALL_COPY && !cpu_has(CPU_ERMSB)) {
+        head = -(uintptr_t)dst & 3;
+        n -= head;
+        words = n / 4;
+        n &= 3;
+        __asm__ volatile ("rep movsb\n"
+                          "mov %3, %0\n"
+                          "rep movsl"
+                          : "+c" (head), "+S" (src), "+D" (dst)
+                          : "r" (words)
+                          : "memory");
+    }
+    __asm__ volatile ("rep movsb"
+                      : "+c" (n), "+S" (src), "+D" (dst)
+                      : : "memory");
+}
+
+/* the same from the end, with the direction flag set */
+static inline void copy_backward(void *dst, const void *src, size_t n)
+{
+    char *d = (char *)dst + n - 1;
+    const char *s = (const char *)src + n - 1;
+    size_t tail, words;
+
+    if (n >= SMALL_COPY) {
+        tail = ((uintptr_t)d + 1) & 3;
+        n -= tail;
+        words = n / 4;
+        n &= 3;
+        /* once the tail is done, d + 1 is aligned and the words start 3
+         * bytes below the pointers */
+        __asm__ volatile ("std\n"
+                          "rep movsb\n"
+                          "sub $3, %1\n"
+                          "sub $3, %2\n"
+                          "mov %3, %0\n"
+                          "rep movsl\n"
+                          "add $3, %1\n"
+                          "add $3, %2\n"
+                          "cld"
+                          : "+c" (tail), "+S" (s), "+D" (d)
+                          : "r" (words)
+                          : "memory");
+    }
+    __asm__ volatile ("std\n"
+                      "rep movsb\n"
+                      "cld"
+                      : "+c" (n), "+S" (s), "+D" (d)
+                      : : "memory");
+}
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+    /* memcpy does not support overlapping buffers, so always do it
+     * forwards. */
+    copy_forward(dst, src, n);
+    return dst;
+}
+
+void *memset(void *ptr, char value, size_t n)
+{
+    void *d = ptr;
+    uint32_t fill = (uint8_t)value * 0x01010101;
+    size_t head, words;
+
+    __asm__ volatile ("cld");
+    if (n >= SMALL_COPY && !cpu_has(CPU_ERMSB)) {
+        head = -(uintptr_t)d & 3;
+        n -= head;
+        words = n / 4;
+        n &= 3;
+        __asm__ volatile ("rep stosb\n"
+                          "mov %3, %0\n"
+                          "rep stosl"
+                          : "+c" (head), "+D" (d)
+                          : "a" (fill), "r" (words)
+                          : "memory");
+    }
+    __asm__ volatile ("rep stosb"
+                      : "+c" (n), "+D" (d)
+                      : "a" (fill)
+                      : "memory");
+    return ptr;
+}
+
+void *memsetw(void *ptr, unsigned short value, size_t n)
+{
+    __asm__ volatile ("cld; rep stosw"
+                      : "+c" (n), "+D" (ptr)
+                      : "a" (value)
+                      : "memory");
+    return ptr;
+}
+
+void *memmove(void *dst, const void *src, size_t n)
+{
+    /* If the destination is above the source, we have to copy
+     * back to front to avoid overwriting the data we want to
+     * copy.
+     *
+     *      dst:      dddddddd
+     *      src:  ssssssss   ^
+     *            |   ^  |___|
+     *            |___|
+     *
+     * If the destination is below the source, we have to copy
+     * front to back.
+     *
+     *      dst:  dddddddd
+     *      src:  ^   ssssssss
+     *            |___|  ^   |
+     *                   |___|
+     */
+    if ((uintptr_t)dst <= (uintptr_t)src || (uintptr_t)dst >= (uintptr_t)src + n) {
+        copy_forward(dst, src, n);
+    } else {
+        copy_backward(dst, src, n);
+    }
+    return dst;
+}
+
+int memcmp(const void *ptr1, const void *ptr2, size_t n)
+{
+    const unsigned char *p1 = ptr1;
+    const unsigned char *p2 = ptr2;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        if (p1[i] != p2[i]) {
+            return (int)(p1[i] - p2[i]);
+        }
+    }
+
+    return 0;
+}
+
+void *memchr(const void *ptr, int value, size_t n)
+{
+    const unsigned char *p = (const unsigned char *)ptr;
+
+    while (n-- > 0) {
+        if (*p == value) {
+            return (void *)p;
+        }
+        ++p;
+    };
+    return NULL;
+}
+
+size_t strlen(const char *str)
+{
+    size_t ret = 0;
+    while (str[ret]) {
+        ++ret;
+    }
+    return ret;
+}
+
+size_t strnlen(const char *str, size_t n)
+{
+    size_t ret = 0;
+    while (ret < n && str[ret]) {
+        ++ret;
+    }
+    return ret;
+}
+
+char *strcat(char *dst, const char *src)
+{
+    size_t offset = strlen(dst);
+    strcpy(dst + offset, src);
+    return dst;
+}
+
+/* the characters compare as unsigned, like the C library */
+int strcmp(const char *s1, const char *s2)
+{
+    size_t i;
+
+    for (i = 0; s1[i] != 0 && s1[i] == s2[i]; ++i);
+
+    if ((unsigned char)s1[i] > (unsigned char)s2[i]) {
+        return 1;
+    } else if (s1[i] == s2[i]) {
+        return 0;
+    }
+    return -1;
+}
+
+int strncmp(const char *s1, const char *s2, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n && s1[i] != 0 && s1[i] == s2[i]; ++i);
+
+    if (i == n) {
+        return 0;
+    } else if ((unsigned char)s1[i] > (unsigned char)s2[i]) {
+        return 1;
+    } else if (s1[i] == s2[i]) {
+        return 0;
+    }
+    return -1;
+}
+
+char *strcpy(char *dst, const char *src)
+{
+    size_t i;
+
+    for (i = 0; src[i]; ++i) {
+        dst[i] = src[i];
+    }
+    dst[i] = 0;
+
+    return dst;
+}
+
+char *strncpy(char *dst, const char *src, size_t n)
+{
+    size_t i;
+
+    for (i = 0; src[i] && n > 0; ++i, --n) {
+        dst[i] = src[i];
+    }
+    //for (; n > 0; ++i, --n) {
+    dst[i] = 0;
+    //}
+
+    return dst;
+}
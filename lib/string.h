@@ -1,5 +1,5 @@
-#ifndef __KERNEL_STRING_H__
-#define __KERNEL_STRING_H__
+#ifndef __LIB_STRING_H__
+#define __LIB_STRING_H__
 
 #include <types.h>
 
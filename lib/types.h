@@ -1,5 +1,5 @@
-#ifndef __KERNEL_TYPES_H__
-#define __KERNEL_TYPES_H__
+#ifndef __LIB_TYPES_H__
+#define __LIB_TYPES_H__
 
 #define NULL ((void *)0UL)
 
@@ -1,65 +1,55 @@
-#include "utils.h"
-#include "vga.h"
+#include <utils.h>
 
+/* like the C library's, without the overflow check */
 long int strtol(const char *str, char **endptr, int base)
 {
         const char *buf = str;
-        long int value = 0;
-        int sign = 1, k = 0;
+        const char *digits;
+        unsigned long value = 0;
+        int negative = 0, k;
 
-        if (base < 2 || base > 36) {
+        if (base != 0 && (base < 2 || base > 36)) {
+                if (endptr != NULL) {
+                        *endptr = (char *)str;
+                }
                 return 0;
         }
 
         /* swallow white spaces */
-        while (*buf == ' ' || *buf == '\t') {
+        while (*buf == ' ' || (*buf >= '\t' && *buf <= '\r')) {
                 ++buf;
         }
 
         /* parse sign if any */
-        if (*buf == '-') {
-                sign = -1;
-                ++buf;
-        } else if (*buf == '+') {
-                sign = 1;
+        if (*buf == '-' || *buf == '+') {
+                negative = *buf == '-';
                 ++buf;
         }
 
-        /* parse base */
-        if (base == 0) {
-                if (*buf == '0') {
-                        if (to_lower(*(++buf)) == 'x' && is_xdigit(buf[1])) {
-                                ++buf;
-                                base = 16;
-                        } else {
-                                base = 8;
-                        }
-                } else {
-                        base = 10;
-                }
-        } else if (base == 16 && buf[0] == '0' && to_lower(buf[1]) == 'x') {
-                str += 2;
+        /* parse base, 0x only counts with a digit after it */
+        if ((base == 0 || base == 16) && buf[0] == '0' &&
+            to_lower(buf[1]) == 'x' && is_xdigit(buf[2])) {
+                buf += 2;
+                base = 16;
+        } else if (base == 0) {
+                base = buf[0] == '0' ? 8 : 10;
         }
 
         /* parse alpha-numerical string */
-        while (is_alnum(*buf)) {
-                if (is_alpha(*buf)) {
-                        k = to_lower(*buf) - 'a' + 10;
-                        if (k > base) {
-                                break;
-                        }
-                } else {
-                        k = *buf - '0';
+        for (digits = buf; is_alnum(*buf); ++buf) {
+                k = is_digit(*buf) ? *buf - '0' : to_lower(*buf) - 'a' + 10;
+                if (k >= base) {
+                        break;
                 }
                 value = value * base + k;
-                ++buf;
         }
 
+        /* nothing read, the end is the start */
         if (endptr != NULL) {
-                *endptr = (char *)buf;
+                *endptr = (char *)(buf == digits ? str : buf);
         }
 
-        return sign * value;
+        return negative ? -(long)value : (long)value;
 }
 
 char *itoa(unsigned long value, char *str, int base)
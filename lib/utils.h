@@ -1,5 +1,5 @@
-#ifndef __KERNEL_UTILS_H__
-#define __KERNEL_UTILS_H__
+#ifndef __LIB_UTILS_H__
+#define __LIB_UTILS_H__
 
 #include <types.h>
 
@@ -8,7 +8,7 @@
 #define is_alpha(c)  (((c) >= 'a' && (c) <= 'z') || ((c) >= 'A' && (c) <= 'Z'))
 #define is_digit(c)  ((c) >= '0' && (c) <= '9')
 #define is_alnum(c)  (is_alpha(c) || is_digit(c))
-#define is_xdigit(c) (is_digit(c) || ((c) > 'a' && (c) < 'f'))
+#define is_xdigit(c) (is_digit(c) || (to_lower(c) >= 'a' && to_lower(c) <= 'f'))
 
 long int strtol(const char *str, char **endptr, int base);
 char *itoa(unsigned long value, char *str, int base);
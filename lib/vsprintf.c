@@ -0,0 +1,351 @@
+#include <vsprintf.h>
+#include <types.h>
+#include <stdarg.h>
+#include <string.h>
+#include <utils.h>
+
+#define LEFT    (1 << 0)
+#define PLUS    (1 << 1)
+#define SIGNED  (1 << 2)
+#define SPACE   (1 << 3)
+#define PREFIX  (1 << 4)
+#define ZEROS   (1 << 5)
+#define LARGE   (1 << 6)
+
+/* The characters are handed to the sink as they are produced, nothing is
+ * formatted in a temporary buffer. The count returned is the number of
+ * characters produced, the sink may have kept fewer of them. */
+
+typedef struct
+{
+        printf_sink_t sink;
+        void *data;
+        int count;
+} out_t;
+
+static const char digits_lower[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+static const char digits_upper[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+static inline void put(out_t *out, char c)
+{
+        out->sink(c, out->data);
+        ++out->count;
+}
+
+static inline void repeat(out_t *out, char c, int n)
+{
+        while (n-- > 0) {
+                put(out, c);
+        }
+}
+
+static void number(out_t *out, unsigned long num, unsigned base, int width, int precision, unsigned flags)
+{
+        char buffer[32];        /* enough for 32 bits in base 2 */
+        const char *digits = (flags & LARGE) ? digits_upper : digits_lower;
+        char sign = 0;
+        int i;
+
+        if (flags & LEFT) {
+                flags &= ~ZEROS;
+        }
+
+        /* work out the sign character to use, if any. Always print a
+         * sign character if the number is negative. */
+        if (flags & SIGNED) {
+                if ((int)num < 0) {
+                        num = -(unsigned)num;
+                        sign = '-';
+                        --width;
+                } else if (flags & PLUS) {
+                        sign = '+';
+                        --width;
+                } else if (flags & SPACE) {
+                        sign = ' ';
+                        --width;
+                }
+        }
+
+        /* reduce field to accomodate any prefixed required. */
+        if (flags & PREFIX) {
+                if (base == 16) {
+                        width -= 2;
+                } else if (base == 8) {
+                        --width;
+                }
+        }
+
+        /* write the number in reverse order to the temporary buffer. */
+        i = 0;
+        do {
+                buffer[i++] = digits[num % base];
+                num /= base;
+        } while (num != 0);
+
+        /* the precision is the minimum number of digits to print,
+         * so if the digit is higher than the precision, set precision
+         * to the digit count. Width then becomes the amount of padding
+         * we require. */
+        if (i > precision) {
+                precision = i;
+        }
+        width -= precision;
+
+        /* we are not left aligned and require space padding. */
+        if (!(flags & (ZEROS | LEFT))) {
+                repeat(out, ' ', width);
+                width = 0;
+        }
+
+        if (sign) {
+                put(out, sign);
+        }
+
+        if (flags & PREFIX) {
+                if (base == 8) {
+                        put(out, '0');
+                } else if (base == 16) {
+                        put(out, '0');
+                        put(out, (flags & LARGE) ? 'X' : 'x');
+                }
+        }
+
+        /* zero padding. */
+        if (flags & ZEROS) {
+                repeat(out, '0', width);
+                width = 0;
+        }
+        repeat(out, '0', precision - i);
+
+        /* write number, reversed to correct direction. */
+        while (i-- > 0) {
+                put(out, buffer[i]);
+        }
+
+        /* right padding for left justification. */
+        repeat(out, ' ', width);
+}
+
+static void string(out_t *out, const char *s, int width, int precision, unsigned flags)
+{
+        int len;
+
+        if (!s) {
+                s = "(null)";
+        }
+        for (len = 0; s[len] && (precision < 0 || len < precision); ++len)
+                ;
+
+        if (!(flags & LEFT)) {
+                repeat(out, ' ', width - len);
+        }
+        for (width -= len; len > 0; --len) {
+                put(out, *s++);
+        }
+        if (flags & LEFT) {
+                repeat(out, ' ', width);
+        }
+}
+
+/* reads a decimal field from the format, leaves fmt after it */
+static int field(const char **fmt)
+{
+        int n = 0;
+
+        while (is_digit(**fmt)) {
+                n = n * 10 + *(*fmt)++ - '0';
+        }
+        return n;
+}
+
+int vcprintf(printf_sink_t sink, void *data, const char *fmt, va_list args)
+{
+        out_t out = { sink, data, 0 };
+        unsigned flags, base;
+        int width, precision;
+
+        if (!fmt) {
+                return 0;
+        }
+
+        for (; *fmt; ++fmt) {
+                if (*fmt != '%') {
+                        put(&out, *fmt);
+                        continue;
+                }
+
+                /* process the flags */
+                flags = 0;
+                for (;;) {
+                        switch (*++fmt) {
+                        case '#':
+                                flags |= PREFIX;
+                                continue;
+                        case '0':
+                                /* LEFT has higher precedence */
+                                if (!(flags & LEFT)) {
+                                        flags |= ZEROS;
+                                }
+                                continue;
+                        case '-':
+                                flags &= ~ZEROS;
+                                flags |= LEFT;
+                                continue;
+                        case '+':
+                                flags |= PLUS;
+                                continue;
+                        case ' ':
+                                flags &= ~PLUS;
+                                flags |= SPACE;
+                                continue;
+                        }
+                        break;
+                }
+
+                /* get the field width */
+                width = -1;
+                if (is_digit(*fmt)) {
+                        width = field(&fmt);
+                } else if (*fmt == '*') {
+                        width = va_arg(args, int);
+                        ++fmt;
+                        if (width < 0) {
+                                width = -width;
+                                flags |= LEFT;
+                        }
+                }
+
+                /* get the precision */
+                precision = -1;
+                if (*fmt == '.') {
+                        ++fmt;
+                        if (is_digit(*fmt)) {
+                                precision = field(&fmt);
+                        } else if (*fmt == '*') {
+                                precision = va_arg(args, int);
+                                ++fmt;
+                        }
+                        if (precision < 0) {
+                                precision = 0;
+                        }
+                }
+
+                /* get the length modifier, long is the size of int */
+                while (*fmt == 'l' || *fmt == 'h' || *fmt == 'z') {
+                        ++fmt;
+                }
+
+                /* get the conversion specifier */
+                base = 0;
+                switch (*fmt) {
+                case 'c':
+                        put(&out, (char)va_arg(args, int));
+                        break;
+                case 's':
+                        string(&out, va_arg(args, const char *), width, precision, flags);
+                        break;
+                case 'd':
+                case 'i':
+                        flags |= SIGNED;
+                        /* fall through */
+                case 'u':
+                        base = 10;
+                        break;
+                case 'o':
+                        base = 8;
+                        break;
+                case 'X':
+                        flags |= LARGE;
+                        /* fall through */
+                case 'x':
+                        base = 16;
+                        break;
+                case 'b':
+                        base = 2;
+                        break;
+                case '%':
+                        put(&out, '%');
+                        break;
+                case '\0':
+                        /* a lone % ends the format */
+                        return out.count;
+                default:
+                        put(&out, '%');
+                        put(&out, *fmt);
+                        break;
+                }
+                if (base) {
+                        number(&out, va_arg(args, unsigned), base, width, precision, flags);
+                }
+        }
+
+        return out.count;
+}
+
+int cprintf(printf_sink_t sink, void *data, const char *fmt, ...)
+{
+        int len;
+        va_list args;
+        va_start(args, fmt);
+        len = vcprintf(sink, data, fmt, args);
+        va_end(args);
+        return len;
+}
+
+typedef struct
+{
+        char *buf;
+        size_t size;    /* room left, the terminating null included */
+} buf_sink_t;
+
+static void buf_sink(char c, void *data)
+{
+        buf_sink_t *b = data;
+
+        if (b->size > 1) {
+                *b->buf++ = c;
+                --b->size;
+        }
+}
+
+/* like the C library: the string is cut to fit in size bytes and always
+ * terminated if size isn't 0, the length it would have is returned */
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list args)
+{
+        buf_sink_t b = { buf, size };
+        int len;
+
+        len = vcprintf(buf_sink, &b, fmt, args);
+        if (size) {
+                *b.buf = '\0';
+        }
+        return len;
+}
+
+int snprintf(char *buf, size_t size, const char *fmt, ...)
+{
+        int len;
+        va_list args;
+        va_start(args, fmt);
+        len = vsnprintf(buf, size, fmt, args);
+        va_end(args);
+        return len;
+}
+
+int vsprintf(char *buf, const char *fmt, va_list args)
+{
+        if (!buf) {
+                return 0;
+        }
+        return vsnprintf(buf, (size_t)-1 >> 1, fmt, args);
+}
+
+int sprintf(char *buf, const char *fmt, ...)
+{
+        int len;
+        va_list args;
+        va_start(args, fmt);
+        len = vsprintf(buf, fmt, args);
+        va_end(args);
+        return len;
+}
@@ -0,0 +1,17 @@
+#ifndef __LIB_VSPRINTF_H__
+#define __LIB_VSPRINTF_H__
+
+#include <stdarg.h>
+#include <types.h>
+
+/* receives the formatted characters one at a time */
+typedef void (*printf_sink_t)(char c, void *data);
+
+int vcprintf(printf_sink_t sink, void *data, const char *fmt, va_list args);
+int cprintf(printf_sink_t sink, void *data, const char *fmt, ...);
+int vsnprintf(char *buf, size_t size, const char *fmt, va_list args);
+int snprintf(char *buf, size_t size, const char *fmt, ...);
+int vsprintf(char *s, const char *fmt, va_list arg);
+int sprintf(char *buf, const char *fmt, ...);
+
+#endif
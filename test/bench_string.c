@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 199309L   /* clock_gettime */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+/* the library's, see test/make.inc */
+void *lib_memcpy(void *dst, const void *src, size_t n);
+void *lib_memmove(void *dst, const void *src, size_t n);
+void *lib_memset(void *ptr, char value, size_t n);
+int lib_snprintf(char *buf, size_t size, const char *fmt, ...);
+extern uint32_t lib_cpu_features;
+
+#define CPU_ERMSB   (1 << 10)   /* as in lib/cpufeature.h */
+#define BYTES       (256 << 20) /* copied for each size */
+
+enum { MEMCPY, MEMMOVE, MEMSET };
+static const char *names[] = { "memcpy", "memmove", "memset" };
+
+static unsigned char src[65536 + 64], dst[65536 + 64];
+
+/* nanoseconds per call */
+static double elapsed(struct timespec *start, long calls)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start->tv_sec) * 1e9 + (end.tv_nsec - start->tv_nsec)) / calls;
+}
+
+/* misaligned means the destination 1 byte past a word, the source 3 */
+static void bench_mem(int which, size_t size, int misaligned)
+{
+    unsigned char *d = dst + (misaligned ? 1 : 0);
+    unsigned char *s = src + (misaligned ? 3 : 0);
+    long calls = BYTES / size, i;
+    struct timespec start;
+    double t_libc, t_words, t_ermsb;
+    uint32_t features;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < calls; ++i) {
+        if (which == MEMCPY) {
+            memcpy(d, s, size);
+        } else if (which == MEMMOVE) {
+            memmove(s + 1, s, size);
+        } else {
+            memset(d, (char)i, size);
+        }
+        __asm__ volatile ("" ::: "memory");
+    }
+    t_libc = elapsed(&start, calls);
+
+    for (features = 0; features <= CPU_ERMSB; features += CPU_ERMSB) {
+        lib_cpu_features = features;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < calls; ++i) {
+            if (which == MEMCPY) {
+                lib_memcpy(d, s, size);
+            } else if (which == MEMMOVE) {
+                lib_memmove(s + 1, s, size);
+            } else {
+                lib_memset(d, (char)i, size);
+            }
+            __asm__ volatile ("" ::: "memory");
+        }
+        if (features) {
+            t_ermsb = elapsed(&start, calls);
+        } else {
+            t_words = elapsed(&start, calls);
+        }
+    }
+
+    printf("%-8s %6zu %-9s %10.1f %10.1f %10.1f\n", names[which], size,
+           misaligned ? "unaligned" : "aligned", t_libc, t_words, t_ermsb);
+}
+
+static void bench_printf(void)
+{
+    char buf[128];
+    long calls = 1000000, i;
+    struct timespec start;
+    double t_libc, t_lib;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < calls; ++i) {
+        snprintf(buf, sizeof(buf), "[%s] cpu %u: %08x %-6d|%5s\n", "sched", (unsigned)i & 7, (unsigned)i, (int)-i, "ok");
+        __asm__ volatile ("" ::: "memory");
+    }
+    t_libc = elapsed(&start, calls);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < calls; ++i) {
+        lib_snprintf(buf, sizeof(buf), "[%s] cpu %u: %08x %-6d|%5s\n", "sched", (unsigned)i & 7, (unsigned)i, (int)-i, "ok");
+        __asm__ volatile ("" ::: "memory");
+    }
+    t_lib = elapsed(&start, calls);
+
+    printf("%-8s %6s %-9s %10.1f %10.1f\n", "snprintf", "", "", t_libc, t_lib);
+}
+
+int main(void)
+{
+    static const size_t sizes[] = { 8, 15, 16, 64, 256, 4096, 65536 };
+    size_t i;
+    int which;
+
+    memset(src, 1, sizeof(src));
+    printf("ns per call      size           C library      words      ermsb\n");
+    for (which = MEMCPY; which <= MEMSET; ++which) {
+        for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+            bench_mem(which, sizes[i], 0);
+            bench_mem(which, sizes[i], 1);
+        }
+    }
+    bench_printf();
+
+    return 0;
+}
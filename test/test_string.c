@@ -0,0 +1,179 @@
+#define _POSIX_C_SOURCE 200809L   /* strnlen */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+/* the library's, see test/make.inc */
+void *lib_memcpy(void *dst, const void *src, size_t n);
+void *lib_memmove(void *dst, const void *src, size_t n);
+void *lib_memset(void *ptr, char value, size_t n);
+size_t lib_strlen(const char *str);
+size_t lib_strnlen(const char *str, size_t n);
+char *lib_strcat(char *dst, const char *src);
+char *lib_strcpy(char *dst, const char *src);
+int lib_strcmp(const char *s1, const char *s2);
+int lib_strncmp(const char *s1, const char *s2, size_t n);
+extern uint32_t lib_cpu_features;
+
+#define CPU_ERMSB   (1 << 10)   /* as in lib/cpufeature.h */
+#define MAX_LEN     100         /* well past the word loop's threshold */
+#define MAX_OFF     8
+#define MAX_SHIFT   9
+#define BUF_SIZE    (MAX_LEN + 4 * MAX_OFF + 2 * MAX_SHIFT)
+
+static int failed = 0;
+
+static void fill(unsigned char *buf, size_t n, unsigned seed)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        buf[i] = (unsigned char)(seed + i * 7);
+    }
+}
+
+static void report(const char *what, size_t len, size_t off, int shift)
+{
+    printf("FAIL %s len %zu offset %zu shift %d features %#x\n",
+           what, len, off, shift, lib_cpu_features);
+    ++failed;
+}
+
+/* every source and destination alignment, the bytes around the
+ * destination must be left alone */
+static void check_memcpy(void)
+{
+    unsigned char src[BUF_SIZE], dst[BUF_SIZE], want[BUF_SIZE];
+    size_t len, s, d;
+
+    for (len = 0; len <= MAX_LEN; ++len) {
+        for (s = 0; s < MAX_OFF; ++s) {
+            for (d = 0; d < MAX_OFF; ++d) {
+                fill(src, sizeof(src), 1);
+                fill(dst, sizeof(dst), 100);
+                memcpy(want, dst, sizeof(want));
+                memcpy(want + MAX_OFF + d, src + s, len);
+                if (lib_memcpy(dst + MAX_OFF + d, src + s, len) != dst + MAX_OFF + d ||
+                    memcmp(dst, want, sizeof(dst)) != 0) {
+                    report("memcpy", len, s * MAX_OFF + d, 0);
+                }
+            }
+        }
+    }
+}
+
+/* the destination below and above the source, overlapping or not */
+static void check_memmove(void)
+{
+    unsigned char buf[BUF_SIZE], want[BUF_SIZE];
+    size_t len, s;
+    int shift;
+
+    for (len = 0; len <= MAX_LEN; ++len) {
+        for (s = 0; s < MAX_OFF; ++s) {
+            for (shift = -MAX_SHIFT; shift <= MAX_SHIFT; ++shift) {
+                unsigned char *src = buf + MAX_SHIFT + MAX_OFF + s;
+                fill(buf, sizeof(buf), 3);
+                memcpy(want, buf, sizeof(want));
+                memmove(want + (src - buf) + shift, want + (src - buf), len);
+                if (lib_memmove(src + shift, src, len) != src + shift ||
+                    memcmp(buf, want, sizeof(buf)) != 0) {
+                    report("memmove", len, s, shift);
+                }
+            }
+        }
+    }
+}
+
+static void check_memset(void)
+{
+    unsigned char buf[BUF_SIZE], want[BUF_SIZE];
+    size_t len, d;
+
+    for (len = 0; len <= MAX_LEN; ++len) {
+        for (d = 0; d < MAX_OFF; ++d) {
+            fill(buf, sizeof(buf), 5);
+            memcpy(want, buf, sizeof(want));
+            memset(want + MAX_OFF + d, 0xa5, len);
+            if (lib_memset(buf + MAX_OFF + d, (char)0xa5, len) != buf + MAX_OFF + d ||
+                memcmp(buf, want, sizeof(buf)) != 0) {
+                report("memset", len, d, 0);
+            }
+        }
+    }
+}
+
+static int sign(int v)
+{
+    return (v > 0) - (v < 0);
+}
+
+static const char *strs[] = {
+    "", "a", "ab", "abc", "abd", "ab\x80", "serial", "serial=38400",
+    "ISA   ", "ISA", "\xff", "trace=sched",
+};
+#define NSTRS   (sizeof(strs) / sizeof(strs[0]))
+
+static void check_str(void)
+{
+    char buf[BUF_SIZE], want[BUF_SIZE];
+    size_t i, j, n;
+
+    for (i = 0; i < NSTRS; ++i) {
+        if (lib_strlen(strs[i]) != strlen(strs[i])) {
+            report("strlen", strlen(strs[i]), i, 0);
+        }
+        for (n = 0; n <= strlen(strs[i]) + 1; ++n) {
+            if (lib_strnlen(strs[i], n) != strnlen(strs[i], n)) {
+                report("strnlen", n, i, 0);
+            }
+        }
+
+        memset(buf, 0x5a, sizeof(buf));
+        memset(want, 0x5a, sizeof(want));
+        strcpy(want, strs[i]);
+        if (lib_strcpy(buf, strs[i]) != buf ||
+          memcmp(buf, want, sizeof(buf)) != 0) {
+            report("strcpy", strlen(strs[i]), i, 0);
+        }
+
+        for (j = 0; j < NSTRS; ++j) {
+            if (sign(lib_strcmp(strs[i], strs[j])) !=
+              sign(strcmp(strs[i], strs[j]))) {
+                report("strcmp", j, i, 0);
+            }
+            for (n = 0; n <= 14; ++n) {
+                if (sign(lib_strncmp(strs[i], strs[j], n)) !=
+                  sign(strncmp(strs[i], strs[j], n))) {
+                    report("strncmp", n, i, (int)j);
+                }
+            }
+
+            strcpy(buf, strs[i]);
+            strcpy(want, strs[i]);
+            strcat(want, strs[j]);
+            if (lib_strcat(buf, strs[j]) != buf ||
+              strcmp(buf, want) != 0) {
+                report("strcat", j, i, 0);
+            }
+        }
+    }
+}
+
+int main(void)
+{
+    /* the word loops, then REP MOVSB/STOSB alone */
+    lib_cpu_features = 0;
+    check_memcpy();
+    check_memmove();
+    check_memset();
+    lib_cpu_features = CPU_ERMSB;
+    check_memcpy();
+    check_memmove();
+    check_memset();
+    check_str();
+
+    printf("string: %s\n", failed ? "FAILED" : "ok");
+    return failed != 0;
+}
@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+/* the library's, see test/make.inc */
+long int lib_strtol(const char *str, char **endptr, int base);
+
+static int failed = 0;
+
+/* the value and where the parsing stopped */
+static void check(const char *str, int base)
+{
+    char *want_end, *got_end;
+    long want, got;
+
+    want = strtol(str, &want_end, base);
+    got = lib_strtol(str, &got_end, base);
+    if (want != got || want_end != got_end) {
+        printf("FAIL strtol(\"%s\", %d): want %ld at %d, got %ld at %d\n",
+               str, base, want, (int)(want_end - str), got, (int)(got_end - str));
+        ++failed;
+    }
+}
+
+int main(void)
+{
+    static const char *numbers[] =
+    {
+        "0", "7", "123", "-42", "+42", "  \t17", "\n-8",
+        "2147483647", "-2147483648", "12abc", "0755", "0789", "08",
+        "0x1f", "0X1F", "-0xff", "0x", "0xg", "ff", "z", "Zz",
+        "101", "", "-", "  ", "x12",
+    };
+    static const int bases[] = { 0, 2, 8, 10, 16, 36 };
+    size_t i, j;
+
+    for (i = 0; i < sizeof(numbers) / sizeof(numbers[0]); ++i) {
+        for (j = 0; j < sizeof(bases) / sizeof(bases[0]); ++j) {
+            check(numbers[i], bases[j]);
+        }
+    }
+
+    printf("utils: %s\n", failed ? "FAILED" : "ok");
+    return failed != 0;
+}
@@ -0,0 +1,84 @@
+#define _POSIX_C_SOURCE 200809L   /* strnlen */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <stdint.h>
+
+/* the library's, see test/make.inc */
+int lib_vsnprintf(char *buf, size_t size, const char *fmt, va_list args);
+int lib_snprintf(char *buf, size_t size, const char *fmt, ...);
+int lib_sprintf(char *buf, const char *fmt, ...);
+
+static int failed = 0;
+
+/* both are given the same buffer size, the bytes past the end have to
+ * be left alone */
+static void check(size_t size, const char *fmt, ...)
+{
+    char want[128], got[128];
+    int want_len, got_len;
+    va_list args;
+
+    memset(want, '#', sizeof(want));
+    memset(got, '#', sizeof(got));
+
+    va_start(args, fmt);
+    want_len = vsnprintf(want, size, fmt, args);
+    va_end(args);
+    va_start(args, fmt);
+    got_len = lib_vsnprintf(got, size, fmt, args);
+    va_end(args);
+
+    if (want_len != got_len || memcmp(want, got, sizeof(want)) != 0) {
+        printf("FAIL \"%s\" size %zu: want %d \"%.*s\", got %d \"%.*s\"\n",
+               fmt, size, want_len, (int)strnlen(want, size), want,
+               got_len, (int)strnlen(got, size), got);
+        ++failed;
+    }
+}
+
+int main(void)
+{
+    char buf[64];
+
+    check(64, "hello");
+    check(64, "%d", 0);
+    check(64, "%d", 1234);
+    check(64, "%d", -1234);
+    check(64, "%i", INT_MIN);
+    check(64, "%d", INT_MAX);
+    check(64, "%u", 4000000000u);
+    check(64, "%+d % d", 5, 5);
+    check(64, "%05d|%-5d|%5d", -42, -42, -42);
+    check(64, "%x %X %o", 0xbeef, 0xbeef, 0755);
+    check(64, "%#x %#o", 0xbeef, 0755);
+    check(64, "%#010x", 0x1234);
+    check(64, "%08x", 0xdeadbeef);
+    check(64, "%.5d", 42);
+    check(64, "%*d|%*d", 6, 42, -6, 42);
+    check(64, "%.*s", 2, "abcdef");
+    check(64, "[%-5s]", "ab");
+    check(64, "[%5s]", "ab");
+    check(64, "[%.3s]", "abcdef");
+    check(64, "[%-8.3s]", "abcdef");
+    check(64, "%c%c%c", 'a', 'b', 'c');
+    check(64, "100%%");
+
+    /* cut to the size, the length it would have is returned */
+    check(6, "hello world");
+    check(6, "%d", -123456789);
+    check(6, "%s and %s", "this", "that");
+    check(1, "hello");
+    check(0, "hello");
+    check(0, "%d", 42);
+
+    if (lib_sprintf(buf, "%s=%d", "x", 7) != 3 || strcmp(buf, "x=7") != 0) {
+        printf("FAIL sprintf: \"%s\"\n", buf);
+        ++failed;
+    }
+
+    printf("vsprintf: %s\n", failed ? "FAILED" : "ok");
+    return failed != 0;
+}